@@ -0,0 +1,118 @@
+#include "body.h"
+#include "level.h"
+
+#include "mem.h"
+
+#include <string.h>
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+#define BD_DEFAULT_LENGTH 2
+void bd_free (struct Bodies *bd)
+{
+	mm_free (bd->x);
+	mm_free (bd->y);
+	mm_free (bd->xv);
+	mm_free (bd->yv);
+	mm_free (bd->on_ground);
+	mm_free (bd->move);
+	mm_free (bd->jump);
+	mm_free (bd->active);
+}
+
+#define GROW(arr) ((arr) = mm_realloc (MM_PLAYERS, (arr), bd->mlen * sizeof(*(arr))))
+// add a body, returning its index
+int bd_add (struct Bodies *bd, const struct Body *b)
+{
+	if (bd->len >= bd->mlen)
+	{
+		bd->mlen = bd->mlen ? bd->mlen*2 : BD_DEFAULT_LENGTH;
+		GROW(bd->x);
+		GROW(bd->y);
+		GROW(bd->xv);
+		GROW(bd->yv);
+		GROW(bd->on_ground);
+		GROW(bd->move);
+		GROW(bd->jump);
+		GROW(bd->active);
+	}
+	int i = bd->len ++;
+	bd_set (bd, i, b);
+	bd->move[i] = 0;
+	bd->jump[i] = 0;
+	bd->active[i] = 0;
+	return i;
+}
+#undef GROW
+
+struct Body bd_get (const struct Bodies *bd, int i)
+{
+	return (struct Body) {bd->x[i], bd->y[i], bd->xv[i], bd->yv[i], bd->on_ground[i]};
+}
+
+void bd_set (struct Bodies *bd, int i, const struct Body *b)
+{
+	bd->x[i] = b->x;
+	bd->y[i] = b->y;
+	bd->xv[i] = b->xv;
+	bd->yv[i] = b->yv;
+	bd->on_ground[i] = b->on_ground;
+}
+
+/* for each active body in [from, to): apply movement and jumping, then
+ * gravity, clamp velocity to +-limit and move; collisions are left to the
+ * caller. Gives the same results, bit for bit, whether or not it is vectorised */
+void bd_integrate (struct Bodies *bd, int from, int to, float limit)
+{
+	int i = from;
+#ifdef __SSE2__
+	const __m128 vmove = _mm_set1_ps (movevel), vjump = _mm_set1_ps (jumpvel),
+		vgrav = _mm_set1_ps (const_grav), vmax = _mm_set1_ps (limit), vmin = _mm_set1_ps (-limit);
+	const __m128i zero = _mm_setzero_si128 ();
+	for (; i + 4 <= to; i += 4)
+	{
+#define LOADI(arr) _mm_loadu_si128 ((__m128i *) &(arr)[i])
+#define BLEND(m,a,b) _mm_or_ps (_mm_and_ps ((m), (a)), _mm_andnot_ps ((m), (b)))
+		__m128i ground = LOADI(bd->on_ground);
+		__m128 active = _mm_castsi128_ps (_mm_cmpeq_epi32 (_mm_cmpeq_epi32 (LOADI(bd->active), zero), zero));
+		__m128 jump = _mm_castsi128_ps (_mm_andnot_si128 (
+			_mm_or_si128 (_mm_cmpeq_epi32 (LOADI(bd->jump), zero), _mm_cmpeq_epi32 (ground, zero)),
+			_mm_set1_epi32 (-1)));
+		__m128 x = _mm_loadu_ps (&bd->x[i]), y = _mm_loadu_ps (&bd->y[i]);
+		__m128 xv = _mm_loadu_ps (&bd->xv[i]), yv = _mm_loadu_ps (&bd->yv[i]);
+		__m128 nxv = _mm_mul_ps (_mm_loadu_ps (&bd->move[i]), vmove);
+		__m128 nyv = _mm_add_ps (BLEND(jump, vjump, yv), vgrav); // gravity (positive y is downwards)
+		nxv = _mm_min_ps (_mm_max_ps (nxv, vmin), vmax);
+		nyv = _mm_min_ps (_mm_max_ps (nyv, vmin), vmax);
+		_mm_storeu_ps (&bd->x[i], BLEND(active, _mm_add_ps (x, nxv), x));
+		_mm_storeu_ps (&bd->y[i], BLEND(active, _mm_add_ps (y, nyv), y));
+		_mm_storeu_ps (&bd->xv[i], BLEND(active, nxv, xv));
+		_mm_storeu_ps (&bd->yv[i], BLEND(active, nyv, yv));
+		_mm_storeu_si128 ((__m128i *) &bd->on_ground[i],
+			_mm_andnot_si128 (_mm_castps_si128 (active), ground));
+#undef BLEND
+#undef LOADI
+	}
+#endif
+	for (; i < to; ++ i)
+	{
+		if (!bd->active[i])
+			continue;
+		float xv = bd->move[i] * movevel, yv = bd->yv[i];
+		if (bd->jump[i] && bd->on_ground[i])
+			yv = jumpvel;
+		yv += const_grav; // gravity (positive y is downwards)
+		if (xv < -limit) xv = -limit;
+		if (xv >  limit) xv =  limit;
+		if (yv < -limit) yv = -limit;
+		if (yv >  limit) yv =  limit;
+		bd->x[i] += xv;
+		bd->y[i] += yv;
+		bd->xv[i] = xv;
+		bd->yv[i] = yv;
+		bd->on_ground[i] = 0;
+	}
+}
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
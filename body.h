@@ -0,0 +1,36 @@
+#ifndef BODY_H_INCLUDED
+#define BODY_H_INCLUDED
+
+/* Prefix bd_ is for player bodies.
+ * The physics state that every player touches every frame is kept apart
+ * from the rest of struct PlayerState, one array per field, so that
+ * bd_integrate can run over many players at once without dragging their
+ * recordings through the cache. */
+
+// a single player's position and velocity
+struct Body
+{
+	float x, y, xv, yv; // pos+velocity
+	int on_ground; // can jump
+};
+
+// every player's position and velocity, plus this frame's input; starts zeroed
+struct Bodies
+{
+	float *x, *y, *xv, *yv;
+	int *on_ground;
+	float *move; // -1, 0 or 1 for left, neither and right
+	int *jump; // wants to jump
+	int *active; // to be moved by bd_integrate this frame
+	int len, mlen;
+};
+
+void bd_free      (struct Bodies *);
+int  bd_add       (struct Bodies *, const struct Body *);
+struct Body bd_get (const struct Bodies *, int);
+void bd_set       (struct Bodies *, int, const struct Body *);
+void bd_integrate (struct Bodies *, int, int, float);
+
+#endif /* BODY_H_INCLUDED */
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
@@ -0,0 +1,143 @@
+#include "export.h"
+
+#include "mem.h"
+#include <stdio.h>
+
+struct Exporter
+{
+	FILE *out;
+	int format; // EX_PPM or EX_Y4M
+	int ph, pw; // frame dimensions
+	Uint32 *queue[EX_QUEUE_LENGTH]; // ring of frames waiting to be written
+	int head, len; // oldest frame in queue, and how many there are
+	int closing; // no more frames coming
+	int error; // a write failed
+	unsigned char *out_buf; // one converted frame
+	SDL_mutex *lock;
+	SDL_cond *not_full, *not_empty;
+	SDL_Thread *writer;
+};
+
+// BT.601 limited range, as most players expect
+#define EX_Y(r,g,b) ((( 66*(r) + 129*(g) +  25*(b) + 128) >> 8) + 16)
+#define EX_U(r,g,b) (((-38*(r) -  74*(g) + 112*(b) + 128) >> 8) + 128)
+#define EX_V(r,g,b) (((112*(r) -  94*(g) -  18*(b) + 128) >> 8) + 128)
+static void ex_convert (struct Exporter *ex, const Uint32 *px)
+{
+	int i, pa = ex->ph * ex->pw;
+	unsigned char *o = ex->out_buf;
+	for (i = 0; i < pa; ++ i)
+	{
+		int r = (px[i] >> 16) & 0xFF, g = (px[i] >> 8) & 0xFF, b = px[i] & 0xFF;
+		if (ex->format == EX_PPM)
+		{
+			o[3*i] = r;
+			o[3*i+1] = g;
+			o[3*i+2] = b;
+		}
+		else
+		{
+			// planar: all of Y, then all of U, then all of V
+			o[i] = EX_Y(r,g,b);
+			o[pa+i] = EX_U(r,g,b);
+			o[2*pa+i] = EX_V(r,g,b);
+		}
+	}
+}
+
+static int ex_writer (void *data)
+{
+	struct Exporter *ex = data;
+	size_t frame_size = 3 * ex->ph * ex->pw;
+	SDL_LockMutex (ex->lock);
+	while (1)
+	{
+		while (!ex->len && !ex->closing)
+			SDL_CondWait (ex->not_empty, ex->lock);
+		if (!ex->len)
+			break; // closing and drained
+		Uint32 *px = ex->queue[ex->head];
+		SDL_UnlockMutex (ex->lock);
+
+		// the slot stays ours until head moves on
+		ex_convert (ex, px);
+		if (ex->format == EX_PPM)
+			fprintf (ex->out, "P6\n%d %d\n255\n", ex->pw, ex->ph);
+		else
+			fputs ("FRAME\n", ex->out);
+		int ok = fwrite (ex->out_buf, 1, frame_size, ex->out) == frame_size;
+
+		SDL_LockMutex (ex->lock);
+		if (!ok)
+			ex->error = 1;
+		ex->head = (ex->head + 1) % EX_QUEUE_LENGTH;
+		-- ex->len;
+		SDL_CondSignal (ex->not_full);
+	}
+	SDL_UnlockMutex (ex->lock);
+	return 0;
+}
+
+/* start writing ph x pw frames to a file in the given format;
+ * returns NULL if the file can't be opened */
+struct Exporter *ex_open (const char *path, int ph, int pw, int format)
+{
+	FILE *out = fopen (path, "wb");
+	if (!out)
+		return NULL;
+	setvbuf (out, NULL, _IOFBF, 1 << 20);
+	if (format == EX_Y4M)
+		fprintf (out, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C444\n", pw, ph);
+
+	struct Exporter *ex = mm_alloc (MM_OTHER, sizeof(struct Exporter));
+	*ex = (struct Exporter) {out, format, ph, pw, {0,}, 0, 0, 0, 0,
+		mm_alloc (MM_FRAMEBUFFER, 3 * ph * pw), SDL_CreateMutex (), SDL_CreateCond (), SDL_CreateCond (), NULL};
+	int i;
+	for (i = 0; i < EX_QUEUE_LENGTH; ++ i)
+		ex->queue[i] = mm_alloc (MM_FRAMEBUFFER, sizeof(Uint32) * ph * pw);
+	ex->writer = SDL_CreateThread (ex_writer, "ex_writer", ex);
+	return ex;
+}
+
+// queue a copy of a frame, waiting only if the queue is full
+void ex_frame (struct Exporter *ex, const Uint32 *px)
+{
+	SDL_LockMutex (ex->lock);
+	while (ex->len == EX_QUEUE_LENGTH)
+		SDL_CondWait (ex->not_full, ex->lock);
+	Uint32 *slot = ex->queue[(ex->head + ex->len) % EX_QUEUE_LENGTH];
+	SDL_UnlockMutex (ex->lock);
+
+	// the writer doesn't look at a slot until len covers it
+	memcpy (slot, px, sizeof(Uint32) * ex->ph * ex->pw);
+
+	SDL_LockMutex (ex->lock);
+	++ ex->len;
+	SDL_CondSignal (ex->not_empty);
+	SDL_UnlockMutex (ex->lock);
+}
+
+// finish writing queued frames and close the file; returns 0 if anything failed
+int ex_close (struct Exporter *ex)
+{
+	SDL_LockMutex (ex->lock);
+	ex->closing = 1;
+	SDL_CondSignal (ex->not_empty);
+	SDL_UnlockMutex (ex->lock);
+	SDL_WaitThread (ex->writer, NULL);
+
+	int ok = !ex->error;
+	if (fclose (ex->out))
+		ok = 0;
+	int i;
+	for (i = 0; i < EX_QUEUE_LENGTH; ++ i)
+		mm_free (ex->queue[i]);
+	mm_free (ex->out_buf);
+	SDL_DestroyCond (ex->not_full);
+	SDL_DestroyCond (ex->not_empty);
+	SDL_DestroyMutex (ex->lock);
+	mm_free (ex);
+	return ok;
+}
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
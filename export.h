@@ -0,0 +1,24 @@
+#ifndef EXPORT_H_INCLUDED
+#define EXPORT_H_INCLUDED
+
+#include "SDL.h"
+
+/* Prefix ex_ is for exporting frames as video.
+ * ex_frame copies a frame into a bounded queue and returns; a writer
+ * thread converts queued frames and streams them to disk, so the caller
+ * only waits when the writer has fallen EX_QUEUE_LENGTH frames behind. */
+
+#define EX_QUEUE_LENGTH 8
+
+#define EX_PPM 0 // concatenated binary PPM images (P6)
+#define EX_Y4M 1 // YUV4MPEG2, 4:4:4, 60fps
+
+struct Exporter;
+
+struct Exporter *ex_open (const char *, int, int, int);
+void ex_frame (struct Exporter *, const Uint32 *);
+int  ex_close (struct Exporter *);
+
+#endif /* EXPORT_H_INCLUDED */
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
@@ -1,11 +1,10 @@
 #include "graphics.h"
+#include "mem.h"
+#include "trace.h"
 
 #include <stdio.h>
 #include <stdarg.h>
 
-/* window dimensions (in pixels) */
-int gr_ph = 0, gr_pw = 0, gr_pa = 0;
-
 /* event callback functions */
 void (*gr_onidle) () = NULL;
 void (*gr_onresize) () = NULL;
@@ -14,43 +13,61 @@ void (*gr_quit) () = NULL;
 
 /* The following static variables are for internal use */
 
-/* Screen data */
-Uint32 *gr_pixels;
-static int gr_pitch;
-
-/* SDL globals */
-static SDL_Window *sdlWindow;
-static SDL_Renderer *sdlRenderer;
-static SDL_Texture *sdlTexture;
-
 /* timing parameters for held keys */
 static uint32_t gr_kinitdelay = 10, gr_kdelay = 10;
 
-/* state for keys being held down */
-static uint32_t key_fire_ms = 0;
-static char cur_key_down = 0;
-static int num_keys_down = 0;
-
-/* state for key timeout */
-static uint32_t end = 0;
-
-/* state for animation-skipping */
-static char peeked = GRK_EOF;
-static int gr_skip_anim = 0;
+/* time between presented frames, for pacing frames that aren't */
+static uint32_t gr_frame_ms = 16;
 
 #ifdef DEBUG_GETCH_TIME
 static uint32_t lastref = 0;
 #endif
 
-void gr_refresh ()
+void gr_refresh (struct Graphics *gr)
 {
 	if (gr_onrefresh)
 		gr_onrefresh ();
+	if (gr->headless)
+		return;
 
-	SDL_UpdateTexture (sdlTexture, NULL, gr_pixels, gr_pitch);
-	SDL_RenderClear (sdlRenderer);
-	SDL_RenderCopy (sdlRenderer, sdlTexture, NULL, NULL);
-	SDL_RenderPresent (sdlRenderer);
+	struct TrSample tr;
+	tr_begin (&tr);
+	SDL_RenderClear (gr->renderer);
+	if (gr->backend == GR_QUADS)
+	{
+#if SDL_VERSION_ATLEAST(2,0,18)
+		if (gr->num_quads)
+			SDL_RenderGeometry (gr->renderer, NULL, gr->verts, 4*gr->num_quads, gr->indices, 6*gr->num_quads);
+#endif
+		// text goes on top, uploading only the rows and columns it covers
+		SDL_Rect *r = &gr->text;
+		if (r->w > 0 && r->h > 0)
+		{
+			SDL_Rect dst = {r->x*gr->vw/gr->pw, r->y*gr->vh/gr->ph, r->w*gr->vw/gr->pw, r->h*gr->vh/gr->ph};
+			SDL_UpdateTexture (gr->texture, r, gr->pixels + r->y*gr->pw + r->x, gr->pitch);
+			SDL_RenderCopy (gr->renderer, gr->texture, r, &dst);
+		}
+	}
+	else
+	{
+		SDL_UpdateTexture (gr->texture, NULL, gr->pixels, gr->pitch);
+		SDL_RenderCopy (gr->renderer, gr->texture, NULL, NULL);
+	}
+	SDL_RenderPresent (gr->renderer);
+	gr->last_frame = gr_getms ();
+	tr_end ("gr_refresh", &tr);
+}
+
+/* take as long over a frame that has nothing new to present as presenting
+ * it would have taken */
+void gr_idle_frame (struct Graphics *gr)
+{
+	if (gr->headless)
+		return;
+	uint32_t ticks = gr_getms (), due = gr->last_frame + gr_frame_ms;
+	if (due > ticks)
+		SDL_Delay (due - ticks);
+	gr->last_frame = due > ticks ? due : ticks;
 }
 
 int gr_inputcode (SDL_Keycode code)
@@ -63,26 +80,38 @@ int gr_inputch (char in)
 	return (in >= 32 && in < 128);
 }
 
-static int gr_down_keys[256] = {0,};
-static int gr_not_seen_up[256] = {0,};
-
-int gr_is_pressed (char in)
+int gr_is_pressed (struct Graphics *gr, char in)
 {
-	return gr_down_keys[(int)in];
+	return gr->down_keys[(int)in];
 }
 
-int gr_is_pressed_debounce (char in)
+int gr_is_pressed_debounce (struct Graphics *gr, char in)
 {
-	if (gr_down_keys[(int)in] && !gr_not_seen_up[(int)in])
+	if (gr->down_keys[(int)in] && !gr->not_seen_up[(int)in])
 	{
-		gr_not_seen_up[(int)in] = 1;
+		gr->not_seen_up[(int)in] = 1;
 		return 1;
 	}
 	return 0;
 }
 
-void gr_update_events ()
+// a key goes down if it was up, or up if it was down
+void gr_toggle (struct Graphics *gr, char in)
 {
+	gr->down_keys[(int)in] = !gr->down_keys[(int)in];
+	if (gr->down_keys[(int)in])
+		gr->not_seen_up[(int)in] = 0;
+	if (gr->num_toggled < GR_TOGGLES)
+		gr->toggled[gr->num_toggled++] = in;
+}
+
+void gr_update_events (struct Graphics *gr)
+{
+	gr->num_toggled = 0;
+	if (gr->headless)
+		return;
+	struct TrSample tr;
+	tr_begin (&tr);
 	SDL_Event sdlEvent;
 	while (SDL_PollEvent (&sdlEvent))
 	{
@@ -92,7 +121,7 @@ void gr_update_events ()
 		{
 			case SDL_KEYDOWN:
 			case SDL_KEYUP:
-				if (sdlEvent.key.repeat)
+				if (sdlEvent.key.repeat || gr->scripted)
 					break;
 				code = sdlEvent.key.keysym.sym;
 				input_key = code%256;
@@ -112,16 +141,11 @@ void gr_update_events ()
 					input_key = GRK_ESC;
 				break;
 
-			/*case SDL_VIDEORESIZE:
-			{
-				// TODO: something nice about window resizing
-				gr_resize (event.resize.h, event.resize.w);
-				break;
-			}*/
-
 			case SDL_WINDOWEVENT:
 				if (sdlEvent.window.event == SDL_WINDOWEVENT_EXPOSED)
-					gr_refresh ();
+					gr_refresh (gr);
+				else if (sdlEvent.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+					gr_resize (gr, sdlEvent.window.data2, sdlEvent.window.data1);
 				break;
 			
 			case SDL_QUIT:
@@ -136,44 +160,43 @@ void gr_update_events ()
 				break;
 		}
 		if (input_key)
-		{
-			gr_down_keys[(int)input_key] = !gr_down_keys[(int)input_key];
-			if (gr_down_keys[(int)input_key])
-				gr_not_seen_up[(int)input_key] = 0;
-		}
+			gr_toggle (gr, input_key);
 	}
+	tr_end ("gr_update_events", &tr);
 }
 
-char gr_getch_aux (int text, int tout_num, int get)
+char gr_getch_aux (struct Graphics *gr, int text, int tout_num, int get)
 {
 	uint32_t ticks = gr_getms ();
 #ifdef DEBUG_GETCH_TIME
 	fprintf(stderr, "Time since last getch: %dms\n", ticks - lastref);
 #endif
-	gr_refresh ();
+	gr_refresh (gr);
+	if (gr->headless)
+		return GRK_EOF;
 
-	if (peeked != GRK_EOF)
+	if (gr->peeked != GRK_EOF)
 	{
-		char ret = peeked;
+		char ret = gr->peeked;
 		if (get)
 		{
-			peeked = GRK_EOF;
-			gr_skip_anim = 0;
+			gr->peeked = GRK_EOF;
+			gr->skip_anim = 0;
 		}
 		return ret;
 	}
 
-	if (tout_num > 0 && end <= ticks)
-		end = tout_num + ticks;
+	if (tout_num > 0 && gr->end <= ticks)
+		gr->end = tout_num + ticks;
 	else if (tout_num <= 0)
-		end = 0;
+		gr->end = 0;
 	SDL_Event sdlEvent;
 	while (1)
 	{
 		ticks = gr_getms ();
-		if (end && ticks >= end)
+		if (gr->end && ticks >= gr->end)
 		{
-			end = 0;
+			gr->end = 0;
 			break;
 		}
 
@@ -181,18 +204,28 @@ char gr_getch_aux (int text, int tout_num, int get)
 		{
 			if (tout_num < 0)
 				return GRK_EOF;
-			if (cur_key_down && ticks >= key_fire_ms)
+			if (gr->cur_key_down && ticks >= gr->key_fire_ms)
 			{
-				key_fire_ms = ticks + gr_kdelay;
+				gr->key_fire_ms = ticks + gr_kdelay;
 				#ifdef DEBUG_GETCH_TIME
 				lastref = ticks;
 				#endif
-				return cur_key_down;
+				return gr->cur_key_down;
 			}
 			if (gr_onidle)
 				gr_onidle ();
-			gr_wait (10, 0);
-			continue;
+
+			/* sleep until there is an event, the timeout is up or a held
+			 * key is due to repeat (-1 waits for ever) */
+			int wait = -1;
+			if (gr->end)
+				wait = gr->end - ticks;
+			if (gr->cur_key_down && (wait < 0 || (int) (gr->key_fire_ms - ticks) < wait))
+				wait = gr->key_fire_ms - ticks;
+			if (gr_onidle && (wait < 0 || wait > 10))
+				wait = 10;
+			if (!SDL_WaitEventTimeout (&sdlEvent, wait))
+				continue;
 		}
 
 		char input_key = 0;
@@ -208,8 +241,8 @@ char gr_getch_aux (int text, int tout_num, int get)
 				code = sdlEvent.key.keysym.sym;
 				if (gr_inputcode(code))
 				{
-					++ num_keys_down;
-					if (num_keys_down == 1 && (!text) &&
+					++ gr->num_keys_down;
+					if (gr->num_keys_down == 1 && (!text) &&
 					    (sdlEvent.key.keysym.mod & (KMOD_LCTRL | KMOD_RCTRL)))
 					{
 						input_key = GR_CTRL(code);
@@ -235,21 +268,16 @@ char gr_getch_aux (int text, int tout_num, int get)
 			case SDL_KEYUP:
 				code = sdlEvent.key.keysym.sym;
 				if (gr_inputcode(code))
-					-- num_keys_down;
-				if (!num_keys_down)
-					cur_key_down = 0;
+					-- gr->num_keys_down;
+				if (!gr->num_keys_down)
+					gr->cur_key_down = 0;
 				break;
 
-			/*case SDL_VIDEORESIZE:
-			{
-				// TODO: something nice about window resizing
-				gr_resize (event.resize.h, event.resize.w);
-				break;
-			}*/
-
 			case SDL_WINDOWEVENT:
 				if (sdlEvent.window.event == SDL_WINDOWEVENT_EXPOSED)
-					gr_refresh ();
+					gr_refresh (gr);
+				else if (sdlEvent.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+					gr_resize (gr, sdlEvent.window.data2, sdlEvent.window.data1);
 				break;
 			
 			case SDL_QUIT:
@@ -263,45 +291,45 @@ char gr_getch_aux (int text, int tout_num, int get)
 			default:
 				break;
 		}
-		if (input_key && input_key == cur_key_down)
+		if (input_key && input_key == gr->cur_key_down)
 			continue;
 		else if (input_key)
 		{
-			cur_key_down = input_key;
+			gr->cur_key_down = input_key;
 			ticks = gr_getms ();
-			key_fire_ms = ticks + gr_kinitdelay;
+			gr->key_fire_ms = ticks + gr_kinitdelay;
 			#ifdef DEBUG_GETCH_TIME
 			lastref = ticks;
 			#endif
 			if (!get)
-				peeked = input_key;
+				gr->peeked = input_key;
 			return input_key;
 		}
 	}
 	return GRK_EOF;
 }
 
-char gr_getch ()
+char gr_getch (struct Graphics *gr)
 {
-	return gr_getch_aux (0, 0, 1);
+	return gr_getch_aux (gr, 0, 0, 1);
 }
 
-char gr_getch_text ()
+char gr_getch_text (struct Graphics *gr)
 {
-	return gr_getch_aux (1, 0, 1);
+	return gr_getch_aux (gr, 1, 0, 1);
 }
 
-char gr_getch_int (int t)
+char gr_getch_int (struct Graphics *gr, int t)
 {
-	return gr_getch_aux (0, t, 1);
+	return gr_getch_aux (gr, 0, t, 1);
 }
 
-void grx_getstr (int zloc, int yloc, int xloc, char *out, int len)
+void grx_getstr (struct Graphics *gr, int zloc, int yloc, int xloc, char *out, int len)
 {
 	int i = 0;
 	while (1)
 	{
-		char in = gr_getch_text ();
+		char in = gr_getch_text (gr);
 		if (in == GRK_RET) break;
 		else if (in == GRK_BS)
 		{
@@ -325,28 +353,230 @@ void grx_getstr (int zloc, int yloc, int xloc, char *out, int len)
 	out[i] = 0;
 }
 
-void gr_resize (int ph, int pw)
+/* the window is now ph by pw; the framebuffer follows it at gr->scale */
+void gr_resize (struct Graphics *gr, int ph, int pw)
 {
-	gr_ph = ph;
-	gr_pw = pw;
-	gr_pa = ph*pw;
-	
-	gr_pitch = sizeof (Uint32) * gr_pw;
-	gr_pixels = realloc (gr_pixels, gr_pitch * gr_ph);
-	memset (gr_pixels, 0, gr_pitch * gr_ph);
+	gr->vh = ph;
+	gr->vw = pw;
+	gr->ph = ph*gr->scale;
+	gr->pw = pw*gr->scale;
+	if (gr->ph < 1)
+		gr->ph = 1;
+	if (gr->pw < 1)
+		gr->pw = 1;
+	gr->pa = gr->ph*gr->pw;
+
+	if (gr->renderer)
+	{
+		if (gr->texture)
+			SDL_DestroyTexture (gr->texture);
+		gr->texture = SDL_CreateTexture (gr->renderer, SDL_PIXELFORMAT_ARGB8888,
+			SDL_TEXTUREACCESS_STREAMING, gr->pw, gr->ph);
+	}
+
+	gr->pitch = sizeof (Uint32) * gr->pw;
+	gr->pixels = mm_realloc (MM_FRAMEBUFFER, gr->pixels, gr->pitch * gr->ph);
+	memset (gr->pixels, 0, gr->pitch * gr->ph);
 
 	if (gr_onresize)
 		gr_onresize ();
 }
 
-void gr_cleanup ()
+/* A 5x7 font for ' ' to '_' (ASCII 32-95; lower case is shown as upper
+ * case and anything else as '?'), a byte per row with the leftmost pixel
+ * in bit 4 */
+static const unsigned char gr_font[64][7] = {
+	{0x00,0x00,0x00,0x00,0x00,0x00,0x00}, {0x04,0x04,0x04,0x04,0x04,0x00,0x04}, // space !
+	{0x0A,0x0A,0x0A,0x00,0x00,0x00,0x00}, {0x0A,0x0A,0x1F,0x0A,0x1F,0x0A,0x0A}, // " #
+	{0x04,0x0F,0x14,0x0E,0x05,0x1E,0x04}, {0x18,0x19,0x02,0x04,0x08,0x13,0x03}, // $ %
+	{0x0C,0x12,0x14,0x08,0x15,0x12,0x0D}, {0x0C,0x04,0x08,0x00,0x00,0x00,0x00}, // & '
+	{0x02,0x04,0x08,0x08,0x08,0x04,0x02}, {0x08,0x04,0x02,0x02,0x02,0x04,0x08}, // ( )
+	{0x00,0x04,0x15,0x0E,0x15,0x04,0x00}, {0x00,0x04,0x04,0x1F,0x04,0x04,0x00}, // * +
+	{0x00,0x00,0x00,0x00,0x0C,0x04,0x08}, {0x00,0x00,0x00,0x1F,0x00,0x00,0x00}, // , -
+	{0x00,0x00,0x00,0x00,0x00,0x0C,0x0C}, {0x00,0x01,0x02,0x04,0x08,0x10,0x00}, // . /
+	{0x0E,0x11,0x13,0x15,0x19,0x11,0x0E}, {0x04,0x0C,0x04,0x04,0x04,0x04,0x0E}, // 0 1
+	{0x0E,0x11,0x01,0x02,0x04,0x08,0x1F}, {0x1F,0x02,0x04,0x02,0x01,0x11,0x0E}, // 2 3
+	{0x02,0x06,0x0A,0x12,0x1F,0x02,0x02}, {0x1F,0x10,0x1E,0x01,0x01,0x11,0x0E}, // 4 5
+	{0x06,0x08,0x10,0x1E,0x11,0x11,0x0E}, {0x1F,0x01,0x02,0x04,0x08,0x08,0x08}, // 6 7
+	{0x0E,0x11,0x11,0x0E,0x11,0x11,0x0E}, {0x0E,0x11,0x11,0x0F,0x01,0x02,0x0C}, // 8 9
+	{0x00,0x0C,0x0C,0x00,0x0C,0x0C,0x00}, {0x00,0x0C,0x0C,0x00,0x0C,0x04,0x08}, // : ;
+	{0x02,0x04,0x08,0x10,0x08,0x04,0x02}, {0x00,0x00,0x1F,0x00,0x1F,0x00,0x00}, // < =
+	{0x08,0x04,0x02,0x01,0x02,0x04,0x08}, {0x0E,0x11,0x01,0x02,0x04,0x00,0x04}, // > ?
+	{0x0E,0x11,0x01,0x0D,0x15,0x15,0x0E}, {0x0E,0x11,0x11,0x11,0x1F,0x11,0x11}, // @ A
+	{0x1E,0x11,0x11,0x1E,0x11,0x11,0x1E}, {0x0E,0x11,0x10,0x10,0x10,0x11,0x0E}, // B C
+	{0x1C,0x12,0x11,0x11,0x11,0x12,0x1C}, {0x1F,0x10,0x10,0x1E,0x10,0x10,0x1F}, // D E
+	{0x1F,0x10,0x10,0x1E,0x10,0x10,0x10}, {0x0E,0x11,0x10,0x17,0x11,0x11,0x0F}, // F G
+	{0x11,0x11,0x11,0x1F,0x11,0x11,0x11}, {0x0E,0x04,0x04,0x04,0x04,0x04,0x0E}, // H I
+	{0x07,0x02,0x02,0x02,0x02,0x12,0x0C}, {0x11,0x12,0x14,0x18,0x14,0x12,0x11}, // J K
+	{0x10,0x10,0x10,0x10,0x10,0x10,0x1F}, {0x11,0x1B,0x15,0x15,0x11,0x11,0x11}, // L M
+	{0x11,0x11,0x19,0x15,0x13,0x11,0x11}, {0x0E,0x11,0x11,0x11,0x11,0x11,0x0E}, // N O
+	{0x1E,0x11,0x11,0x1E,0x10,0x10,0x10}, {0x0E,0x11,0x11,0x11,0x15,0x12,0x0D}, // P Q
+	{0x1E,0x11,0x11,0x1E,0x14,0x12,0x11}, {0x0F,0x10,0x10,0x0E,0x01,0x01,0x1E}, // R S
+	{0x1F,0x04,0x04,0x04,0x04,0x04,0x04}, {0x11,0x11,0x11,0x11,0x11,0x11,0x0E}, // T U
+	{0x11,0x11,0x11,0x11,0x11,0x0A,0x04}, {0x11,0x11,0x11,0x15,0x15,0x15,0x0A}, // V W
+	{0x11,0x11,0x0A,0x04,0x0A,0x11,0x11}, {0x11,0x11,0x11,0x0A,0x04,0x04,0x04}, // X Y
+	{0x1F,0x01,0x02,0x04,0x08,0x10,0x1F}, {0x0E,0x08,0x08,0x08,0x08,0x08,0x0E}, // Z [
+	{0x00,0x10,0x08,0x04,0x02,0x01,0x00}, {0x0E,0x02,0x02,0x02,0x02,0x02,0x0E}, // \ ]
+	{0x04,0x0A,0x11,0x00,0x00,0x00,0x00}, {0x00,0x00,0x00,0x00,0x00,0x00,0x1F}  // ^ _
+};
+
+// font pixels in a character cell, including a gap after and around each glyph
+#define GR_CELL_W 6
+#define GR_CELL_H 9
+
+/* draw the whole font, white on black, at a size to suit the framebuffer:
+ * glyph g is glyph_h rows of glyph_w pixels, starting at atlas + g*glyph_h*glyph_w */
+static void gr_build_atlas (struct Graphics *gr)
+{
+	int s = gr->scale*2 + 0.5, g, y, x;
+	if (s < 1)
+		s = 1;
+	gr->glyph_w = GR_CELL_W*s;
+	gr->glyph_h = GR_CELL_H*s;
+	gr->atlas = mm_alloc (MM_FRAMEBUFFER, sizeof(Uint32) * 64 * gr->glyph_h * gr->glyph_w);
+	for (g = 0; g < 64; ++ g)
+		for (y = 0; y < gr->glyph_h; ++ y)
+			for (x = 0; x < gr->glyph_w; ++ x)
+			{
+				// a row of blank pixels above, so lines of text don't touch
+				int fy = y/s - 1, fx = x/s;
+				int on = fy >= 0 && fy < 7 && fx < 5 && (gr_font[g][fy] >> (4 - fx) & 1);
+				gr->atlas[(g*gr->glyph_h + y)*gr->glyph_w + x] = on ? PIXEL_VALUE(255,255,255) : PIXEL_VALUE(0,0,0);
+			}
+}
+
+// grow the part of pixels gr_text has drawn on to take in a rectangle, clipped to the framebuffer
+static void gr_add_text (struct Graphics *gr, int y, int x, int h, int w)
 {
-	SDL_DestroyRenderer (sdlRenderer);
-	SDL_DestroyWindow (sdlWindow);
-	SDL_Quit ();
+	if (y < 0)
+		h += y, y = 0;
+	if (y + h > gr->ph)
+		h = gr->ph - y;
+	if (h <= 0 || w <= 0)
+		return;
+	SDL_Rect *r = &gr->text;
+	if (r->w > 0)
+	{
+		int bottom = r->y + r->h > y + h ? r->y + r->h : y + h,
+			right = r->x + r->w > x + w ? r->x + r->w : x + w;
+		if (r->y < y)
+			y = r->y;
+		if (r->x < x)
+			x = r->x;
+		h = bottom - y;
+		w = right - x;
+	}
+	*r = (SDL_Rect) {x, y, w, h};
 }
 
-void gr_init (int ph, int pw)
+// which glyph to show for a character
+static int gr_glyph (char c)
+{
+	if (c >= 'a' && c <= 'z')
+		c -= 'a' - 'A';
+	if (c < ' ' || c > '_')
+		c = '?';
+	return c - ' ';
+}
+
+/* write a line of text with its top left corner at (y, x), a row of the
+ * framebuffer at a time so each glyph row is one copy; characters that
+ * don't fit are left off. returns the x just after the last one */
+int gr_text (struct Graphics *gr, int y, int x, const char *str)
+{
+	int n = strlen (str), cw = gr->glyph_w, ch = gr->glyph_h, i, r;
+	if (n > (gr->pw - x)/cw)
+		n = (gr->pw - x)/cw;
+	if (x < 0 || n <= 0)
+		return x;
+	int g[n];
+	for (i = 0; i < n; ++ i)
+		g[i] = gr_glyph (str[i]);
+	for (r = 0; r < ch; ++ r)
+	{
+		if (y + r < 0 || y + r >= gr->ph)
+			continue;
+		Uint32 *row = gr->pixels + (y + r)*gr->pw + x;
+		for (i = 0; i < n; ++ i)
+			memcpy (row + i*cw, gr->atlas + (g[i]*ch + r)*cw, sizeof(Uint32) * cw);
+	}
+	gr_add_text (gr, y, x, ch, n*cw);
+	return x + n*cw;
+}
+
+// start drawing a new frame: forget the last one's quads and text
+void gr_new_frame (struct Graphics *gr)
+{
+	gr->num_quads = 0;
+	gr->text = (SDL_Rect) {0, 0, 0, 0};
+}
+
+#if SDL_VERSION_ATLEAST(2,0,18)
+static SDL_Color gr_colour (Uint32 val)
+{
+	return (SDL_Color) {(val >> 16) & 0xFF, (val >> 8) & 0xFF, val & 0xFF, (val >> 24) & 0xFF};
+}
+#endif
+
+/* queue a rectangle, in window coordinates, shaded from one colour along its
+ * top edge to another along its bottom (GR_QUADS) */
+void gr_quad (struct Graphics *gr, float y, float x, float h, float w, Uint32 top, Uint32 bottom)
+{
+#if SDL_VERSION_ATLEAST(2,0,18)
+	if (gr->num_quads == gr->max_quads)
+	{
+		gr->max_quads = gr->max_quads ? 2*gr->max_quads : 256;
+		gr->verts = mm_realloc (MM_FRAMEBUFFER, gr->verts, sizeof(SDL_Vertex) * 4 * gr->max_quads);
+		gr->indices = mm_realloc (MM_FRAMEBUFFER, gr->indices, sizeof(int) * 6 * gr->max_quads);
+	}
+	int q = gr->num_quads ++;
+	SDL_Vertex *v = gr->verts + 4*q;
+	SDL_Color t = gr_colour (top), b = gr_colour (bottom);
+	v[0] = (SDL_Vertex) {{x, y}, t, {0, 0}};
+	v[1] = (SDL_Vertex) {{x + w, y}, t, {0, 0}};
+	v[2] = (SDL_Vertex) {{x, y + h}, b, {0, 0}};
+	v[3] = (SDL_Vertex) {{x + w, y + h}, b, {0, 0}};
+	int *i = gr->indices + 6*q;
+	i[0] = 4*q; i[1] = 4*q + 1; i[2] = 4*q + 2;
+	i[3] = 4*q + 1; i[4] = 4*q + 3; i[5] = 4*q + 2;
+#endif
+}
+
+/* a screen of ph by pw with nothing drawn on it yet */
+static struct Graphics *gr_alloc (int ph, int pw, float scale, int headless)
+{
+	struct Graphics *gr = mm_alloc (MM_OTHER, sizeof(struct Graphics));
+	*gr = (struct Graphics) {0, 0, 0, 0, 0, scale, NULL, 0, headless, NULL, NULL, NULL,
+		{0,}, {0,}, {0,}, 0, 0, 0, 0, 0, 0, GRK_EOF, 0, 0, NULL, 0, 0,
+		GR_PIXELS, 0, 0, {0, 0, 0, 0}};
+	gr_resize (gr, ph, pw);
+	gr_build_atlas (gr);
+	return gr;
+}
+
+void gr_free (struct Graphics *gr)
+{
+	if (gr->texture)
+		SDL_DestroyTexture (gr->texture);
+	if (gr->renderer)
+		SDL_DestroyRenderer (gr->renderer);
+	if (gr->window)
+		SDL_DestroyWindow (gr->window);
+	mm_free (gr->pixels);
+	mm_free (gr->atlas);
+#if SDL_VERSION_ATLEAST(2,0,18)
+	if (gr->verts)
+	{
+		mm_free (gr->verts);
+		mm_free (gr->indices);
+	}
+#endif
+	mm_free (gr);
+}
+
+/* open a window of ph by pw, drawn at scale times that size by the given
+ * backend; there should only be one of these, as it takes all of SDL's events */
+struct Graphics *gr_init (int ph, int pw, float scale, int backend)
 {
 	if (SDL_Init (SDL_INIT_VIDEO) < 0)
 	{
@@ -354,47 +584,91 @@ void gr_init (int ph, int pw)
 		exit (1);
 	}
 
-	atexit (gr_cleanup);
-	sdlWindow = SDL_CreateWindow ("Yore", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-		pw, ph, 0);
-	if (sdlWindow == NULL)
+	atexit (SDL_Quit);
+	struct Graphics *gr = gr_alloc (ph, pw, scale, 0);
+#if !SDL_VERSION_ATLEAST(2,0,18)
+	if (backend == GR_QUADS)
+	{
+		fprintf (stderr, "Drawing quads needs SDL 2.0.18 or later; filling pixels instead\n");
+		backend = GR_PIXELS;
+	}
+#endif
+	gr->backend = backend;
+	gr->window = SDL_CreateWindow ("Yore", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+		pw, ph, SDL_WINDOW_RESIZABLE);
+	if (gr->window == NULL)
 	{
 		fprintf (stderr, "SDL error: window is NULL\n");
 		exit (1);
 	}
 
-	sdlRenderer = SDL_CreateRenderer (sdlWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-	if (sdlRenderer == NULL)
+	gr->renderer = SDL_CreateRenderer (gr->window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+	if (gr->renderer == NULL) // no GPU: both backends work on the software renderer
+		gr->renderer = SDL_CreateRenderer (gr->window, -1, SDL_RENDERER_SOFTWARE);
+	if (gr->renderer == NULL)
 	{
 		fprintf (stderr, "SDL error: renderer is NULL\n");
 		exit (1);
 	}
-	SDL_SetRenderDrawColor(sdlRenderer, 0, 0, 0, 255);
-	SDL_RenderClear (sdlRenderer);
-	SDL_SetRenderDrawBlendMode (sdlRenderer, SDL_BLENDMODE_NONE);
-	sdlTexture = SDL_CreateTexture (sdlRenderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, pw, ph);
+	SDL_SetRenderDrawColor(gr->renderer, 0, 0, 0, 255);
+	SDL_RenderClear (gr->renderer);
+	SDL_SetRenderDrawBlendMode (gr->renderer, SDL_BLENDMODE_NONE);
+
+	gr_resize (gr, ph, pw);
+	return gr;
+}
+
+/* set up a screen of the given size with no window behind it, for
+ * rendering as fast as possible; any number of these can be used at once,
+ * from different threads */
+struct Graphics *gr_init_headless (int ph, int pw, float scale)
+{
+	return gr_alloc (ph, pw, scale, 1);
+}
 
-	gr_resize (ph, pw);
+/* fill a rectangle of the framebuffer, clipped to its edges and to rows
+ * [top, bottom) so that separate bands can be filled at the same time */
+void gr_fill_rows (struct Graphics *gr, int top, int bottom, int y, int x, int h, int w, Uint32 val)
+{
+	int i, j;
+	if (top < 0)
+		top = 0;
+	if (bottom > gr->ph)
+		bottom = gr->ph;
+	if (y < top)
+		h -= top - y, y = top;
+	if (x < 0)
+		w += x, x = 0;
+	if (y + h > bottom)
+		h = bottom - y;
+	if (x + w > gr->pw)
+		w = gr->pw - x;
+	for (i = 0; i < h; ++ i)
+	{
+		Uint32 *row = gr->pixels + (y + i)*gr->pw + x;
+		for (j = 0; j < w; ++ j)
+			row[j] = val;
+	}
 }
 
-char gr_wait (uint32_t ms, int interrupt)
+char gr_wait (struct Graphics *gr, uint32_t ms, int interrupt)
 {
-	if (!ms)
+	if (!ms || gr->headless)
 		return GRK_EOF;
 	if (!interrupt)
 	{
 		SDL_Delay (ms);
 		return GRK_EOF;
 	}
-	if (gr_skip_anim)
+	if (gr->skip_anim)
 	{
 		/* don't want to hang */
 		SDL_Delay (1);
 		return GRK_EOF;
 	}
-	char out = gr_getch_aux (0, ms, 0);
+	char out = gr_getch_aux (gr, 0, ms, 0);
 	if (out != GRK_EOF)
-		gr_skip_anim = 1;
+		gr->skip_anim = 1;
 	return out;
 }
 
@@ -13,8 +13,52 @@
  * grx_ is the graph prefix for messing with a Graph fully;
  * gra_ for just in 2d */
 
-extern int gr_ph, gr_pw, gr_pa;
-extern Uint32 *gr_pixels;
+// most key changes gr_update_events notes in toggled; any more aren't noted
+#define GR_TOGGLES 64
+
+/* A screen to draw on, and the keyboard that goes with it. Every gr_
+ * function works on one of these, so any number can be in use at once;
+ * only one should have a window, though, as it takes all of SDL's events. */
+struct Graphics
+{
+	int ph, pw, pa; // framebuffer dimensions (in pixels)
+	int vh, vw; // window dimensions, which is how much of the world is in view
+	float scale; // framebuffer size as a fraction of the window size; the
+	             // renderer scales it back up when the frame is presented
+	Uint32 *pixels; // the framebuffer
+	int pitch;
+	int headless; // no window: frames are only drawn into pixels, and there is no input
+	SDL_Window *window;
+	SDL_Renderer *renderer;
+	SDL_Texture *texture;
+	int down_keys[256], not_seen_up[256]; // keys held, and debounced presses
+	char toggled[GR_TOGGLES]; // keys that went down or up in the last gr_update_events
+	int num_toggled;
+	int scripted; // keys only come from gr_toggle, not the keyboard
+	uint32_t key_fire_ms; // when a held key next repeats
+	char cur_key_down;
+	int num_keys_down;
+	uint32_t end; // when gr_getch_aux times out
+	char peeked; // for animation-skipping
+	int skip_anim;
+	uint32_t last_frame; // when the last frame was presented
+	Uint32 *atlas; // every glyph of the font, ready to be copied in by gr_text
+	int glyph_h, glyph_w; // size of a character cell (in pixels)
+	int backend; // GR_PIXELS or GR_QUADS
+	int num_quads, max_quads;
+	SDL_Rect text; // the part of pixels gr_text has drawn on this frame (GR_QUADS)
+#if SDL_VERSION_ATLEAST(2,0,18)
+	SDL_Vertex *verts; // four per quad queued by gr_quad (GR_QUADS)
+	int *indices; // six per quad
+#endif
+};
+
+// how a windowed Graphics puts frames on screen
+#define GR_PIXELS 0 // everything is drawn into pixels, which is uploaded whole
+#define GR_QUADS  1 // shapes are queued by gr_quad and drawn by the renderer in
+                    // one batch; only what gr_text wrote to pixels is uploaded.
+                    // Needs SDL_RenderGeometry (SDL 2.0.18): gr_init falls
+                    // back to GR_PIXELS when built against anything older
 
 //extern void (*gr_onidle) ();
 extern void (*gr_onresize) ();
@@ -22,25 +66,37 @@ extern void (*gr_onresize) ();
 extern void (*gr_quit) ();
 
 /* Initialisation */
-void gr_init      (int ph, int pw);
+struct Graphics *gr_init (int ph, int pw, float scale, int backend);
+struct Graphics *gr_init_headless (int ph, int pw, float scale);
+void gr_free      (struct Graphics *);
 
 /* Output */
-void gr_refresh   ();
+void gr_refresh   (struct Graphics *);
+void gr_idle_frame(struct Graphics *);
+void gr_fill_rows (struct Graphics *, int top, int bottom, int y, int x, int h, int w, Uint32 val);
+#define gr_fill(gr,y,x,h,w,v) (gr_fill_rows ((gr), 0, (gr)->ph, (y), (x), (h), (w), (v)))
+int  gr_text      (struct Graphics *, int y, int x, const char *);
+void gr_new_frame (struct Graphics *);
+void gr_quad      (struct Graphics *, float y, float x, float h, float w, Uint32 top, Uint32 bottom);
 
 /* Input */
-int gr_is_pressed (char in);
-int gr_is_pressed_debounce (char in);
-void gr_update_events ();
-
-char gr_getch     ();
-char gr_getch_text();
-char gr_getch_int (int);
-void grx_getstr   (int z, int y, int x, char *, int);
-#define gra_getstr(g,y,x,s,i) (grx_getstr ((g), 0, (y), (x), (s), (i)))
-
-char gr_wait      (uint32_t, int);
+int gr_is_pressed (struct Graphics *, char in);
+int gr_is_pressed_debounce (struct Graphics *, char in);
+void gr_update_events (struct Graphics *);
+void gr_toggle    (struct Graphics *, char);
+
+char gr_getch     (struct Graphics *);
+char gr_getch_text(struct Graphics *);
+char gr_getch_int (struct Graphics *, int);
+void grx_getstr   (struct Graphics *, int z, int y, int x, char *, int);
+#define gra_getstr(gr,g,y,x,s,i) (grx_getstr ((gr), (g), 0, (y), (x), (s), (i)))
+
+char gr_wait      (struct Graphics *, uint32_t, int);
 uint32_t gr_getms ();
-void gr_resize    (int, int);
+void gr_resize    (struct Graphics *, int, int);
+
+/* opaque pixel of a given colour */
+#define PIXEL_VALUE(a,b,c) (((a)<<16) | ((b)<<8) | ((c)<<0) | 0xFF000000)
 
 /* control-key of a lower-case character */
 #define GR_CTRL(ch) ((ch)-96)
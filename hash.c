@@ -0,0 +1,125 @@
+#include "hash.h"
+#include "level.h"
+#include "mem.h"
+
+#include <string.h>
+
+// splitmix64's finaliser: every input bit affects every output bit
+static uint64_t hc_mix (uint64_t h)
+{
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+	return h;
+}
+
+static uint64_t hc_float (float f)
+{
+	uint32_t u;
+	memcpy (&u, &f, sizeof(u));
+	return u;
+}
+
+// one tile's contribution to a level's hash
+uint64_t hc_tile (int b, char c)
+{
+	return hc_mix (((uint64_t) b << 8) | (unsigned char) c);
+}
+
+uint64_t hc_level (const char *level)
+{
+	uint64_t h = 0;
+	int b;
+	for (b = 0; level[b]; ++ b)
+		h ^= hc_tile (b, level[b]);
+	return h;
+}
+
+// add the frame just simulated to the level's hash chain
+void hc_record (struct LevelState *ls)
+{
+	Vector hashes = ls->hashes;
+	uint64_t h = hashes->len ? *(uint64_t *) v_at (hashes, hashes->len - 1) : 0;
+	h = hc_mix (h ^ ls->tile_hash);
+	int i;
+	for (i = 0; i < ls->player_states->len; ++ i)
+	{
+		struct PlayerState *ps = v_at (ls->player_states, i);
+		struct Body b = bd_get (&ls->bodies, ps->id);
+		h = hc_mix (h ^ ((uint64_t) ps->extant << 32 | b.on_ground));
+		h = hc_mix (h ^ (hc_float (b.x) << 32 | hc_float (b.y)));
+		h = hc_mix (h ^ (hc_float (b.xv) << 32 | hc_float (b.yv)));
+	}
+	v_push (hashes, &h);
+}
+
+/* hash of everything draw_level would show in a window of vh by vw (the
+ * framebuffer's size follows from it); the same hash means the same picture */
+uint64_t hc_view (struct LevelState *ls, int vh, int vw)
+{
+	uint64_t h = hc_mix (ls->tile_hash ^ ((uint64_t) vh << 32 | vw));
+	h = hc_mix (h ^ (hc_float (ls->camx) << 32 | hc_float (ls->camy)));
+	int i;
+	for (i = 0; i < ls->player_states->len; ++ i)
+	{
+		struct PlayerState *ps = v_at (ls->player_states, i);
+		if (!ps->extant)
+			continue;
+		h = hc_mix (h ^ ((uint64_t) i << 1 | (ps->rec.curinput == -1)));
+		h = hc_mix (h ^ (hc_float (ls->bodies.x[ps->id]) << 32 | hc_float (ls->bodies.y[ps->id])));
+	}
+	return h;
+}
+
+/* first index at which two chains differ, or -1 if they are the same;
+ * if one is a prefix of the other they differ where the shorter ends */
+int hc_diverge (Vector a, Vector b)
+{
+	int len = a->len < b->len ? a->len : b->len;
+	int lo = 0, hi = len;
+	// chains that agree at i agree everywhere before i
+	while (lo < hi)
+	{
+		int mid = (lo + hi)/2;
+		if (*(uint64_t *) v_at (a, mid) != *(uint64_t *) v_at (b, mid))
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	if (lo == len && a->len == b->len)
+		return -1;
+	return lo;
+}
+
+void hc_write (FILE *f, Vector hashes)
+{
+	int i;
+	fprintf (f, "hashes %d\n", hashes->len);
+	for (i = 0; i < hashes->len; ++ i)
+		fprintf (f, "%016llx\n", (unsigned long long) *(uint64_t *) v_at (hashes, i));
+}
+
+// read a chain written by hc_write, or return NULL if there isn't one
+Vector hc_read (FILE *f)
+{
+	int len;
+	if (fscanf (f, " hashes %d", &len) != 1 || len < 0)
+		return NULL;
+	Vector hashes = v_init (sizeof(uint64_t), len + 1, MM_HISTORY);
+	while (len --)
+	{
+		unsigned long long h;
+		if (fscanf (f, " %llx", &h) != 1)
+		{
+			v_free (hashes);
+			return NULL;
+		}
+		uint64_t h64 = h;
+		v_push (hashes, &h64);
+	}
+	return hashes;
+}
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
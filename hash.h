@@ -0,0 +1,28 @@
+#ifndef HASH_H_INCLUDED
+#define HASH_H_INCLUDED
+
+#include "vector.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/* Prefix hc_ is for world-state hash chains.
+ * Each frame's hash covers every tile and every player's body; tiles are
+ * hashed incrementally (XOR of one term per tile, updated as tiles change)
+ * so a frame costs O(players). Each frame's hash is folded into the chain
+ * so far, so two runs agree on a frame's chain value only if they agreed
+ * on every frame up to it, and the first divergent frame can be found by
+ * binary search. */
+
+struct LevelState;
+
+uint64_t hc_tile   (int, char);
+uint64_t hc_level  (const char *);
+void     hc_record (struct LevelState *);
+uint64_t hc_view   (struct LevelState *, int, int);
+int      hc_diverge (Vector, Vector);
+void     hc_write  (FILE *, Vector);
+Vector   hc_read   (FILE *);
+
+#endif /* HASH_H_INCLUDED */
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
@@ -0,0 +1,224 @@
+#include "journal.h"
+
+#include "mem.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+
+// longest line; a frame's key changes always fit
+#define JN_LINE 256
+
+struct Journal
+{
+	FILE *f;
+	int frame; // jn_frame calls so far
+	// writing
+	char *ring; // JN_BUFFER bytes of lines waiting to be written
+	int head, len; // oldest byte in ring, and how many there are
+	int closing; // no more lines coming
+	int error; // a write failed
+	SDL_mutex *lock;
+	SDL_cond *not_full, *not_empty;
+	SDL_Thread *writer;
+	// replaying (ring is NULL)
+	struct Graphics *gr; // where the keys go
+	char next[JN_LINE]; // the next line not yet used, or "" at the end
+	int next_frame; // the frame it starts with
+	int body; // where the rest of it starts
+	int diverged; // the game stopped doing what the journal says it did
+};
+
+static int jn_writer (void *data)
+{
+	struct Journal *jn = data;
+	SDL_LockMutex (jn->lock);
+	while (1)
+	{
+		while (!jn->len && !jn->closing)
+			SDL_CondWait (jn->not_empty, jn->lock);
+		if (!jn->len)
+			break; // closing and drained
+		// as much as is there without wrapping round
+		int n = jn->len;
+		if (n > JN_BUFFER - jn->head)
+			n = JN_BUFFER - jn->head;
+		SDL_UnlockMutex (jn->lock);
+
+		// the bytes stay ours until head moves past them
+		int ok = fwrite (jn->ring + jn->head, 1, n, jn->f) == n && !fflush (jn->f);
+
+		SDL_LockMutex (jn->lock);
+		if (!ok)
+			jn->error = 1;
+		jn->head = (jn->head + n) % JN_BUFFER;
+		jn->len -= n;
+		SDL_CondSignal (jn->not_full);
+	}
+	SDL_UnlockMutex (jn->lock);
+	return 0;
+}
+
+// queue a line to be written, waiting only if the ring is full
+static void jn_put (struct Journal *jn, const char *line, int n)
+{
+	SDL_LockMutex (jn->lock);
+	while (JN_BUFFER - jn->len < n)
+		SDL_CondWait (jn->not_full, jn->lock);
+	int tail = (jn->head + jn->len) % JN_BUFFER, first = n;
+	if (first > JN_BUFFER - tail)
+		first = JN_BUFFER - tail;
+	memcpy (jn->ring + tail, line, first);
+	memcpy (jn->ring, line + first, n - first);
+	jn->len += n;
+	SDL_CondSignal (jn->not_empty);
+	SDL_UnlockMutex (jn->lock);
+}
+
+/* start a new journal; returns NULL if the file can't be opened */
+struct Journal *jn_open (const char *path)
+{
+	FILE *f = fopen (path, "w");
+	if (!f)
+		return NULL;
+	struct Journal *jn = mm_alloc (MM_OTHER, sizeof(struct Journal));
+	*jn = (struct Journal) {f, 0, mm_alloc (MM_OTHER, JN_BUFFER), 0, 0, 0, 0,
+		SDL_CreateMutex (), SDL_CreateCond (), SDL_CreateCond (), NULL, NULL, "", 0, 0, 0};
+	jn->writer = SDL_CreateThread (jn_writer, "jn_writer", jn);
+	jn_put (jn, "timetravel-journal 1\n", 21);
+	return jn;
+}
+
+// read the next whole line to replay, or note the end of the journal
+static void jn_advance (struct Journal *jn)
+{
+	if (!fgets (jn->next, JN_LINE, jn->f) || !strchr (jn->next, '\n') ||
+		sscanf (jn->next, "%d %n", &jn->next_frame, &jn->body) != 1)
+		jn->next[0] = 0; // finished, or cut off by a crash
+}
+
+// stop replaying and give the keyboard back
+static void jn_finish (struct Journal *jn)
+{
+	if (!jn->gr->scripted)
+		return;
+	fprintf (stderr, "journal: replayed to frame %d%s\n", jn->frame,
+		jn->diverged ? ", where the game went a different way" : "");
+	jn->next[0] = 0;
+	jn->gr->scripted = 0;
+	memset (jn->gr->down_keys, 0, sizeof(jn->gr->down_keys));
+}
+
+/* play a journal back through gr; returns NULL if it can't be opened or
+ * isn't a journal */
+struct Journal *jn_replay (const char *path, struct Graphics *gr)
+{
+	FILE *f = fopen (path, "r");
+	if (!f)
+		return NULL;
+	int version;
+	if (fscanf (f, "timetravel-journal %d ", &version) != 1 || version != 1)
+	{
+		fclose (f);
+		return NULL;
+	}
+	struct Journal *jn = mm_alloc (MM_OTHER, sizeof(struct Journal));
+	*jn = (struct Journal) {f, 0, NULL, 0, 0, 0, 0, NULL, NULL, NULL, NULL, gr, "", 0, 0, 0};
+	gr->scripted = 1;
+	jn_advance (jn);
+	return jn;
+}
+
+/* called once a frame, just after gr_update_events: note the keys that
+ * changed, or make the changes the journal has for this frame */
+void jn_frame (struct Journal *jn, struct Graphics *gr)
+{
+	int f = jn->frame ++, i;
+	if (jn->ring)
+	{
+		if (!gr->num_toggled)
+			return;
+		char line[JN_LINE];
+		int n = sprintf (line, "%d k", f);
+		for (i = 0; i < gr->num_toggled; ++ i)
+			n += sprintf (line + n, " %02x", gr->toggled[i]);
+		line[n++] = '\n';
+		jn_put (jn, line, n);
+		return;
+	}
+	if (!jn->next[0])
+	{
+		jn_finish (jn);
+		return;
+	}
+	if (jn->next_frame < f)
+	{
+		// the journal has something for an earlier frame the game never got to
+		jn->diverged = 1;
+		jn_finish (jn);
+		return;
+	}
+	int key, n;
+	char *s;
+	while (jn->next[0] && jn->next_frame == f && !strncmp (jn->next + jn->body, "k ", 2))
+	{
+		for (s = jn->next + jn->body + 1; sscanf (s, "%x%n", &key, &n) == 1; s += n)
+			gr_toggle (gr, key);
+		jn_advance (jn);
+	}
+}
+
+/* something happened in the game: note it, or check it's what happened
+ * before. The line is printf-style, and gets the frame put in front */
+void jn_event (struct Journal *jn, const char *fmt, ...)
+{
+	char line[JN_LINE];
+	int n = sprintf (line, "%d ", jn->frame);
+	va_list args;
+	va_start (args, fmt);
+	n += vsnprintf (line + n, JN_LINE - n - 1, fmt, args);
+	va_end (args);
+	if (n > JN_LINE - 2)
+		n = JN_LINE - 2;
+	line[n++] = '\n';
+	line[n] = 0;
+	if (jn->ring)
+		jn_put (jn, line, n);
+	else if (jn->next[0] && !strcmp (line, jn->next))
+		jn_advance (jn);
+	else if (jn->next[0])
+	{
+		jn->diverged = 1;
+		jn_finish (jn);
+	}
+}
+
+// finish writing and close the file; returns 0 if anything failed (or a replay diverged)
+int jn_close (struct Journal *jn)
+{
+	int ok;
+	if (jn->ring)
+	{
+		SDL_LockMutex (jn->lock);
+		jn->closing = 1;
+		SDL_CondSignal (jn->not_empty);
+		SDL_UnlockMutex (jn->lock);
+		SDL_WaitThread (jn->writer, NULL);
+		ok = !jn->error && !fsync (fileno (jn->f));
+		mm_free (jn->ring);
+		SDL_DestroyCond (jn->not_full);
+		SDL_DestroyCond (jn->not_empty);
+		SDL_DestroyMutex (jn->lock);
+	}
+	else
+	{
+		jn_finish (jn);
+		ok = !jn->diverged;
+	}
+	if (fclose (jn->f))
+		ok = 0;
+	mm_free (jn);
+	return ok;
+}
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
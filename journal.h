@@ -0,0 +1,33 @@
+#ifndef JOURNAL_H_INCLUDED
+#define JOURNAL_H_INCLUDED
+
+#include "graphics.h"
+
+/* Prefix jn_ is for the session journal.
+ * Every key that goes down or up is appended to the journal against the
+ * frame it was read on, along with a line for each level started, each
+ * attempt at it and how the attempt ended, so a whole session - every
+ * death, paradox and time travel included - can be played again exactly by
+ * feeding the keys back in. Lines are put in a fixed JN_BUFFER-byte ring
+ * and a writer thread appends them to the file and flushes it, so memory
+ * stays the same however long the session goes on, and a crash loses at
+ * most the lines not yet flushed (a torn last line is ignored on replay).
+ *
+ * A journal opened for replay works the other way: jn_frame hands the
+ * keys back to the Graphics in place of the keyboard, and jn_event checks
+ * the game does what it did before. Once the journal runs out the
+ * keyboard takes over again. */
+
+#define JN_BUFFER (64 << 10)
+
+struct Journal;
+
+struct Journal *jn_open   (const char *);
+struct Journal *jn_replay (const char *, struct Graphics *);
+void jn_frame (struct Journal *, struct Graphics *);
+void jn_event (struct Journal *, const char *, ...);
+int  jn_close (struct Journal *);
+
+#endif /* JOURNAL_H_INCLUDED */
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
@@ -0,0 +1,81 @@
+#include "keys.h"
+
+#include "mem.h"
+#include <string.h>
+
+// which chunk run i is in
+static int kr_chunk (int i)
+{
+	return 31 - __builtin_clz (i/KR_FIRST + 1);
+}
+
+struct Keys *kr_at (const struct KeyRuns *kr, int i)
+{
+	int c = kr_chunk (i);
+	return &kr->chunk[c]->keys[i - KR_FIRST*((1 << c) - 1)];
+}
+
+static struct KrChunk *kr_alloc (int c)
+{
+	struct KrChunk *ch = mm_alloc (MM_RECORDINGS, sizeof(struct KrChunk) + sizeof(struct Keys) * (KR_FIRST << c));
+	SDL_AtomicSet (&ch->refs, 1);
+	return ch;
+}
+
+// let go of a chunk, freeing it if nobody else has it
+static void kr_release (struct KrChunk *ch)
+{
+	if (SDL_AtomicDecRef (&ch->refs))
+		mm_free (ch);
+}
+
+// copy chunk c if it's shared with a fork, before changing any of its runs
+static void kr_own (struct KeyRuns *kr, int c)
+{
+	if (SDL_AtomicGet (&kr->chunk[c]->refs) == 1)
+		return;
+	struct KrChunk *ch = kr_alloc (c);
+	int n = kr->len - KR_FIRST*((1 << c) - 1);
+	memcpy (ch->keys, kr->chunk[c]->keys, sizeof(struct Keys) * n);
+	kr_release (kr->chunk[c]);
+	kr->chunk[c] = ch;
+}
+
+// add a run to the end of the slab
+struct Keys *kr_push (struct KeyRuns *kr, const struct Keys *k)
+{
+	int c = kr_chunk (kr->len);
+	if (!kr->chunk[c])
+		kr->chunk[c] = kr_alloc (c);
+	else
+		kr_own (kr, c);
+	struct Keys *slot = kr_at (kr, kr->len ++);
+	*slot = *k;
+	return slot;
+}
+
+// the newest run, to change
+struct Keys *kr_last (struct KeyRuns *kr)
+{
+	kr_own (kr, kr_chunk (kr->len - 1));
+	return kr_at (kr, kr->len - 1);
+}
+
+// make to a slab with the same runs as from, sharing from's chunks
+void kr_fork (struct KeyRuns *to, const struct KeyRuns *from)
+{
+	int c;
+	*to = *from;
+	for (c = 0; c < KR_CHUNKS && to->chunk[c]; ++ c)
+		SDL_AtomicIncRef (&to->chunk[c]->refs);
+}
+
+void kr_free (struct KeyRuns *kr)
+{
+	int c;
+	for (c = 0; c < KR_CHUNKS && kr->chunk[c]; ++ c)
+		kr_release (kr->chunk[c]);
+	*kr = (struct KeyRuns) {{0,}, 0};
+}
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
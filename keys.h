@@ -0,0 +1,50 @@
+#ifndef KEYS_H_INCLUDED
+#define KEYS_H_INCLUDED
+
+#include "SDL.h"
+
+/* Prefix kr_ is for key runs: every player's struct Keys in a level, kept
+ * together in one slab. Only the live player records, and it is always the
+ * newest player, so each player's runs are one unbroken range of the slab
+ * and playing them back walks along memory. The slab is a few chunks, each
+ * twice the size of the one before; chunks never move once made, so runs
+ * can be read (by the speculator's worker, or two-phase frames) while the
+ * live player adds more, and a level's runs go back in a handful of frees.
+ * Forked levels share chunks: whichever changes a shared chunk first copies
+ * it, leaving the old one to the others with the same runs in it, so full
+ * chunks stay shared for good and readers never see a run change. */
+
+#define MAX_SIMULTANEOUS_KEYS 10
+
+// records which keys held down (up to a max number) and for how many frames
+struct Keys
+{
+	char held[MAX_SIMULTANEOUS_KEYS]; // an initial segment is the keys held; padded with 0
+	int frames;
+};
+
+#define KR_FIRST  64 // runs in the first chunk
+#define KR_CHUNKS 24 // enough for KR_FIRST * (2^KR_CHUNKS - 1) runs
+
+struct KrChunk
+{
+	SDL_atomic_t refs; // slabs using it
+	struct Keys keys[];
+};
+
+// the slab; starts zeroed
+struct KeyRuns
+{
+	struct KrChunk *chunk[KR_CHUNKS]; // chunk c holds runs [KR_FIRST*(2^c - 1), KR_FIRST*(2^(c+1) - 1))
+	int len; // runs in use
+};
+
+struct Keys *kr_at   (const struct KeyRuns *, int);
+struct Keys *kr_push (struct KeyRuns *, const struct Keys *);
+struct Keys *kr_last (struct KeyRuns *);
+void         kr_fork (struct KeyRuns *, const struct KeyRuns *);
+void         kr_free (struct KeyRuns *);
+
+#endif /* KEYS_H_INCLUDED */
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
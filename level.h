@@ -0,0 +1,163 @@
+#ifndef LEVEL_H_INCLUDED
+#define LEVEL_H_INCLUDED
+
+#include "vector.h"
+#include "body.h"
+#include "keys.h"
+#include <stdint.h>
+
+/* Prefixes:
+ * ls_ for things to do with a whole level (tiles plus players);
+ * ps_ for a single player's state;
+ * rec_ for a player's recording of keystrokes */
+
+extern const float blockwidth;
+extern const float maxvel; // the usual speed limit, and the furthest a player moves between collision checks
+#define REMOTE_LEVERS 2 // levers '1' on can be pulled from anywhere by the live player ("contracts")
+#define MAX_SUBSTEPS 64 // most substeps a player moves in a frame, so speed limits go up to MAX_SUBSTEPS*maxvel
+extern const float jumpvel, const_grav;
+extern const float movevel;
+
+struct PlayerRecording
+{
+	float i_plx, i_ply, i_plxv, i_plyv; // pos+velocity at start of recording
+	int start; // start frame (always 0?)
+	struct KeyRuns *runs; // the level's slab of struct Keys
+	int first, len; // this recording's are runs [first, first+len)
+	char prevheld[MAX_SIMULTANEOUS_KEYS], held[MAX_SIMULTANEOUS_KEYS]; // current and previous frame keys
+	int prevnum, num; // number of keys held in current and prev frame
+	int differ; // does cur frame contain a key not held in prev frame
+	int curinput, curframe; // curinput = -1 if using player input; else records where we are in playback
+};
+
+struct PlayerState
+{
+	int id; // where the player's body is in the level's bodies
+	float plw; // width (and height) of player
+	int extant; // currently in play
+	struct PlayerRecording rec; // where to record keystrokes to/read from
+	int lever; // tile of a lever pulled this frame, or -1 (two-phase frames only)
+	int state; // what next_player_state returned this frame (two-phase frames only)
+	int tile; // tile the player was on at the start of this frame
+};
+
+// how ls_step orders the players within a frame
+#define LS_SERIAL    0 // each moves and pulls levers in turn, seeing earlier players' levers
+#define LS_TWO_PHASE 1 // all move against the same level, then levers apply in player order
+
+// one tile altered by a lever, as kept in the undo log
+struct TileChange
+{
+	int b; // which tile
+	char from, to; // its value before and after
+};
+
+// how a level starts out, as filled in by one of the setups
+struct Setup
+{
+	const char *initlevel, *control, *cantravel, *action;
+	int levelw;
+	float i_plx, i_ply; // where the first player starts
+};
+
+/* One game session: its screen and keyboard, the level being played and
+ * how to play it. Sessions share nothing, so any number can run at once. */
+struct Engine
+{
+	struct Graphics *gr; // where frames are drawn and keys are read
+	struct ThreadPool *pool; // draws frames in bands, and shares out two-phase frames (NULL for just this thread)
+	struct Setup setup; // the level being played
+	int curlevel; // index into setups
+	int update_mode; // how ls_step orders each frame
+	int speculate; // move recorded players ahead on another thread (LS_SERIAL only)
+	int review; // open the replay viewer after each verified solution
+	const char *save_prefix; // where to save verified solutions
+	int hashing; // keep a hash chain of every frame (saved with solutions)
+	int checking; // check saved solutions against their hash chains
+	int export_format; // EX_PPM or EX_Y4M to render solutions as video
+	struct Exporter *exporter; // takes each frame drawn while set
+	struct Journal *journal; // where keys and outcomes are written (NULL if not)
+	struct Journal *replay; // where keys come from instead of the keyboard, while it lasts (NULL if not)
+	int hud; // show the frame number, ghosts and frame times over the level
+	float step_ms, draw_ms; // how long the last frame's ls_step and drawing took
+	float maxvel; // speed limit for levels this session starts
+	struct SaveState *quicksave; // kept with k while playing and put back with l (NULL until then)
+};
+
+// where a Game is up to
+#define GM_LEVEL   0 // about to set up the current level
+#define GM_ATTEMPT 1 // about to add a live player and run the level through
+#define GM_PLAY    2 // running with the live player
+#define GM_CHECK   3 // running the finished level's recordings through to check them
+#define GM_REVIEW  4 // in the replay viewer
+#define GM_OVER    5 // quit, or every level done
+
+/* A session's way through the levels, one frame per gm_step, so whoever
+ * calls it can do whatever they like between frames (or run several). */
+struct Game
+{
+	struct Engine *en;
+	int phase; // GM_ constant
+	struct LevelState *ls; // the level being played (NULL between levels)
+	struct Body ips; // where the next live player starts
+	struct Replay *rp; // the solution being reviewed (GM_REVIEW only)
+	struct Preload *next; // the next level, being set up on another thread (NULL if not)
+};
+
+struct LevelState
+{
+	struct Engine *en; // the session playing this level
+	int frame; // frames simulated since the level was last reset
+	char *level, *initlevel; // current and inital state of level
+	char *ctrl; // what levers control what squares
+	char *cantravel; // can time travel in a given column
+	char *action; // how the levers behave
+	int levelw, levelh; // level dimensions
+	float camx, camy; // camera location (pixels)
+	Vector player_states; // all players' states
+	struct Bodies bodies; // all players' positions and velocities
+	struct KeyRuns runs; // all players' recorded keys
+	Vector undo; // struct TileChange for each tile altered since the last reset
+	int frame_undo; // length of undo at the start of the current frame
+	int update; // LS_SERIAL or LS_TWO_PHASE
+	struct ThreadPool *pool; // shares out drawing and two-phase movement (NULL for just this thread)
+	uint64_t tile_hash; // XOR of hc_tile over every tile
+	Vector hashes; // hash chain value after each frame since reset (NULL to not hash)
+	uint64_t drawn; // hc_view of the last frame drawn into en->gr
+	struct Speculator *spec; // moves recorded players ahead (NULL if not)
+	int paradox; // the last frame's -1 was a paradox rather than a death
+	float maxvel; // speed limit; above the global maxvel, players move in substeps
+	SDL_atomic_t *tiles_shared; // how many forks share level, or NULL if it's this one's own
+	SDL_atomic_t *setup_shared; // likewise for initlevel, ctrl, cantravel and action
+};
+
+/* level */
+struct LevelState *ls_init (struct Engine *, const struct Setup *);
+void ls_free       (struct LevelState *);
+struct LevelState *ls_fork (struct LevelState *);
+int  ls_step       (struct LevelState *);
+int  ls_step_range (struct LevelState *, int, int, int *);
+void ls_reset      (struct LevelState *);
+void ls_set_tile   (struct LevelState *, int, char);
+void ls_rollback   (struct LevelState *, int);
+void ls_use_ctrl   (struct LevelState *, char);
+void ls_follow     (struct LevelState *, struct PlayerState *);
+void draw_level    (struct LevelState *);
+
+/* game */
+int  gm_step       (struct Game *);
+void gm_free       (struct Game *);
+
+/* players */
+void new_player    (struct LevelState *, const struct Body *, int);
+int  next_player_state (struct LevelState *, struct PlayerState *);
+int  ps_input      (struct LevelState *, struct PlayerState *);
+int  ps_finish     (struct LevelState *, struct PlayerState *);
+void ps_reset      (struct LevelState *, struct PlayerState *);
+
+/* misc */
+int  block         (float, float, int);
+
+#endif /* LEVEL_H_INCLUDED */
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
@@ -1,97 +1,131 @@
 #include "graphics.h"
 #include "vector.h"
+#include "level.h"
+#include "replay.h"
+#include "pool.h"
+#include "body.h"
+#include "export.h"
+#include "hash.h"
+#include "tile.h"
+#include "perf.h"
+#include "trace.h"
+#include "spec.h"
+#include "mem.h"
+#include "journal.h"
+#include "reach.h"
+#include "state.h"
 #include <math.h>
+#include <stdarg.h>
 
 const float blockwidth = 120, maxvel = 18;
 const float jumpvel = -16, const_grav = 0.8;
 const float movevel = 5;
 
-#define MAX_SIMULTANEOUS_KEYS 10
-
-// records which keys held down (up to a max number) and for how many frames
-struct Keys
-{
-	char held[MAX_SIMULTANEOUS_KEYS]; // an initial segment is the keys held; padded with 0
-	int frames;
-};
-
-struct PlayerRecording
+struct LevelState *ls_init (struct Engine *en, const struct Setup *s)
 {
-	float i_plx, i_ply, i_plxv, i_plyv; // pos+velocity at start of recording
-	int start; // start frame (always 0?)
-	Vector inputs; // vector of struct Keys
-	char prevheld[MAX_SIMULTANEOUS_KEYS], held[MAX_SIMULTANEOUS_KEYS]; // current and previous frame keys
-	int prevnum, num; // number of keys held in current and prev frame
-	int differ; // does cur frame contain a key not held in prev frame
-	int curinput, curframe; // curinput = -1 if using player input; else records where we are in playback
-};
+	struct LevelState *ls = mm_alloc (MM_LEVEL, sizeof(struct LevelState));
+	int len = strlen(s->initlevel), levelw = s->levelw;
+	*ls = (struct LevelState) {en, 0, mm_alloc (MM_LEVEL, len+1), mm_alloc (MM_LEVEL, len+1), mm_alloc (MM_LEVEL, len+1),
+		NULL, mm_alloc (MM_LEVEL, strlen(s->action)+1), levelw, (len-1)/levelw + 1,
+		0, 0, v_dinit (sizeof(struct PlayerState), MM_PLAYERS), {0,}, {{0,}, 0}, v_dinit (sizeof(struct TileChange), MM_HISTORY), 0,
+		LS_SERIAL, NULL, hc_level (s->initlevel), NULL, 0, NULL, 0, maxvel, NULL, NULL};
+	strcpy (ls->level, s->initlevel);
+	strcpy (ls->initlevel, s->initlevel);
+	strcpy (ls->ctrl, s->control);
+	if (s->cantravel)
+	{
+		ls->cantravel = mm_alloc (MM_LEVEL, levelw+1);
+		strcpy (ls->cantravel, s->cantravel);
+	}
+	strcpy (ls->action, s->action);
+	return ls;
+}
 
-struct PlayerState
+// one more fork shares something
+static SDL_atomic_t *ls_share (SDL_atomic_t **shared)
 {
-	float plx, ply, plxv, plyv; // pos+velocity
-	int on_ground; // can jump
-	float plw; // width (and height) of player
-	int extant; // currently in play
-	struct PlayerRecording rec; // where to record keystrokes to/read from
-};
+	if (!*shared)
+	{
+		*shared = mm_alloc (MM_LEVEL, sizeof(SDL_atomic_t));
+		SDL_AtomicSet (*shared, 1);
+	}
+	SDL_AtomicIncRef (*shared);
+	return *shared;
+}
 
-struct LevelState
+// one fewer does; returns whether it was the last, so the thing can go
+static int ls_release (SDL_atomic_t **shared)
 {
-	int frame; // which frame (unused)
-	char *level, *initlevel; // current and inital state of level
-	char *ctrl; // what levers control what squares
-	char *cantravel; // can time travel in a given column
-	char *action; // how the levers behave
-	int levelw, levelh; // level dimensions
-	float camx, camy; // camera location (pixels)
-	Vector player_states; // all players' states
-};
+	if (!*shared)
+		return 1;
+	int last = SDL_AtomicDecRef (*shared);
+	if (last)
+		mm_free (*shared);
+	*shared = NULL;
+	return last;
+}
 
-struct LevelState *ls_init (const char *level, const char *ctrl,
-	const char *cantravel, const char *action, int levelw)
+void ls_free (struct LevelState *ls)
 {
-	struct LevelState *ls = malloc (sizeof(struct LevelState));
-	int len = strlen(level);
-	*ls = (struct LevelState) {0, malloc(len+1), malloc(len+1), malloc(len+1),
-		NULL, malloc(strlen(action)+1), levelw, (len-1)/levelw + 1,
-		0, 0, v_dinit (sizeof(struct PlayerState))};
-	strcpy (ls->level, level);
-	strcpy (ls->initlevel, level);
-	strcpy (ls->ctrl, ctrl);
-	if (cantravel)
+	if (ls_release (&ls->tiles_shared))
+		mm_free (ls->level);
+	if (ls_release (&ls->setup_shared))
 	{
-		ls->cantravel = malloc(levelw+1);
-		strcpy (ls->cantravel, cantravel);
+		mm_free (ls->initlevel);
+		mm_free (ls->ctrl);
+		if (ls->cantravel)
+			mm_free (ls->cantravel);
+		mm_free (ls->action);
 	}
-	strcpy (ls->action, action);
-	return ls;
+	v_free (ls->player_states);
+	bd_free (&ls->bodies);
+	kr_free (&ls->runs);
+	v_free (ls->undo);
+	if (ls->hashes)
+		v_free (ls->hashes);
+	mm_free (ls);
 }
 
-void ls_free (struct LevelState *ls)
+/* a copy of a level to go a different way from it, as independent of it
+ * as one made with ls_init. Tiles and recordings are shared until either
+ * side changes them (tiles through ls_set_tile, recordings as the live
+ * player adds or lengthens runs), so forking costs a copy of the players and
+ * the undo log. The fork has no speculator or pool, so it can be stepped on
+ * any thread, and no hash chain: copying one would cost a uint64_t for every
+ * frame played, so a fork that is to be hashed gets a chain of its own, which
+ * carries on from ls's if it starts with ls's last hash */
+struct LevelState *ls_fork (struct LevelState *ls)
 {
-	free (ls->level);
-	free (ls->initlevel);
-	free (ls->ctrl);
-	if (ls->cantravel)
-		free (ls->cantravel);
-	free (ls->action);
+	struct LevelState *f = mm_alloc (MM_LEVEL, sizeof(struct LevelState));
+	*f = *ls;
+	f->tiles_shared = ls_share (&ls->tiles_shared);
+	f->setup_shared = ls_share (&ls->setup_shared);
+	f->player_states = v_copy (ls->player_states);
 	int i;
-	for (i = 0; i < ls->player_states->len; ++ i)
+	for (i = 0; i < f->player_states->len; ++ i)
+		((struct PlayerState *) v_at (f->player_states, i))->rec.runs = &f->runs;
+	f->bodies = (struct Bodies) {0,};
+	for (i = 0; i < ls->bodies.len; ++ i)
 	{
-		struct PlayerState *ps = v_at (ls->player_states, i);
-		v_free (ps->rec.inputs);
+		struct Body b = bd_get (&ls->bodies, i);
+		bd_add (&f->bodies, &b);
 	}
-	v_free (ls->player_states);
-	free (ls);
+	kr_fork (&f->runs, &ls->runs);
+	f->undo = v_copy (ls->undo);
+	f->pool = NULL;
+	f->hashes = NULL;
+	f->spec = NULL;
+	return f;
 }
 
 // whether controlled by player or recording is transparent to caller
-int rec_isdown_aux (struct PlayerRecording *rec, char c, int (*pressed)(char))
+int rec_isdown_aux (struct Graphics *gr, struct PlayerRecording *rec, char c,
+	int (*pressed)(struct Graphics *, char))
 {
 	if (rec->curinput >= 0) // controlled by recording
 	{
 		int i;
-		char *held = ((struct Keys *)v_at(rec->inputs, rec->curinput))->held;
+		char *held = kr_at (rec->runs, rec->first + rec->curinput)->held;
 		// read from recording:
 		for (i = 0; i < MAX_SIMULTANEOUS_KEYS && held[i]; ++ i)
 			if (held[i] == c)
@@ -100,7 +134,7 @@ int rec_isdown_aux (struct PlayerRecording *rec, char c, int (*pressed)(char))
 	}
 	// not controlled by recording!
 	// read keys from actual player using supplied function:
-	if (!pressed (c))
+	if (!pressed (gr, c))
 		return 0;
 	// c is being pressed!
 	// add to recording if not there:
@@ -129,49 +163,50 @@ int rec_isdown_aux (struct PlayerRecording *rec, char c, int (*pressed)(char))
 	return 1;
 }
 
-int rec_isdown (struct PlayerRecording *rec, char c)
+int rec_isdown (struct Graphics *gr, struct PlayerRecording *rec, char c)
 {
-	return rec_isdown_aux (rec, c, gr_is_pressed);
+	return rec_isdown_aux (gr, rec, c, gr_is_pressed);
 }
 
-int rec_isdown_debounce (struct PlayerRecording *rec, char c)
+int rec_isdown_debounce (struct Graphics *gr, struct PlayerRecording *rec, char c)
 {
-	return rec_isdown_aux (rec, c, gr_is_pressed_debounce);
+	return rec_isdown_aux (gr, rec, c, gr_is_pressed_debounce);
 }
 
 // return values
 // 0: continue as normal; 1: recording finished; 2: time-travels; 3: finish level
-int rec_finishframe (struct PlayerRecording *rec)
+int rec_finishframe (struct Graphics *gr, struct PlayerRecording *rec)
 {
 	if (rec->curinput >= 0) // controlled by recording
 	{
 		rec->curframe ++; // next frame in same struct Keys
-		if (rec->curframe >= ((struct Keys *)v_at(rec->inputs, rec->curinput))->frames)
+		if (rec->curframe >= kr_at (rec->runs, rec->first + rec->curinput)->frames)
 		{
 			// next struct Keys:
 			rec->curframe = 0;
 			rec->curinput ++;
-			if (rec->curinput >= rec->inputs->len) // no more struct Keys
+			if (rec->curinput >= rec->len) // no more struct Keys
 				return 1; // recording finished; player time-travelled back at this point
 		}
 		return 0;
 	}
 	int ret = 0;
-	if (gr_is_pressed_debounce ('t'))
+	if (gr_is_pressed_debounce (gr, 't'))
 		ret = 2;
-	else if (gr_is_pressed_debounce (GRK_RET))
+	else if (gr_is_pressed_debounce (gr, GRK_RET))
 		ret = 3;
 	// if there is a prev frame, and it has the same # of held keys as the current one,
 	// and no different ones, then they are the same set of keys (not necessarily same order)
-	if (rec->inputs->len && rec->num == rec->prevnum && !rec->differ)
+	if (rec->len && rec->num == rec->prevnum && !rec->differ)
 		// add one frame of the same:
-		((struct Keys *)v_at (rec->inputs, rec->inputs->len - 1))->frames ++;
+		kr_last (rec->runs)->frames ++; // the live player's runs are at the end
 	else
 	{
 		// new key-frame hahahaha
 		struct Keys k = {{0,}, 1};
 		memcpy (k.held, rec->held, MAX_SIMULTANEOUS_KEYS);
-		v_push (rec->inputs, &k);
+		kr_push (rec->runs, &k); // the live player is the newest, so its runs are at the end
+		++ rec->len;
 		// copy cur to prev
 		memcpy (rec->prevheld, rec->held, MAX_SIMULTANEOUS_KEYS);
 		rec->prevnum = rec->num;
@@ -189,47 +224,46 @@ int block (float x, float y, int levelw)
 }
 
 // jiggle players and their velocities to stop overlaps between player and level
-void check_collisions (struct PlayerState *ps, struct LevelState *ls)
+static void resolve_collisions (struct Body *p, float plw, int live, struct LevelState *ls)
 {
 	int levelw = ls->levelw;
 	char *level = ls->level;
-	float plw = ps->plw;
 	int levelh = ls->levelh;
-	if (ps->plx < 0)
+	if (p->x < 0)
 	{
-		ps->plx = 0;
-		ps->plxv = 0;
+		p->x = 0;
+		p->xv = 0;
 	}
-	else if (ps->plx + plw > levelw*blockwidth)
+	else if (p->x + plw > levelw*blockwidth)
 	{
-		ps->plx = levelw*blockwidth - plw;
-		ps->plxv = 0;
+		p->x = levelw*blockwidth - plw;
+		p->xv = 0;
 	}
-	if (ps->ply < 0)
+	if (p->y < 0)
 	{
-		ps->ply = 0;
-		ps->plyv = 0;
+		p->y = 0;
+		p->yv = 0;
 	}
-	else if (ps->ply + plw > levelh*blockwidth)
+	else if (p->y + plw > levelh*blockwidth)
 	{
-		ps->ply = levelh*blockwidth - plw;
-		ps->plyv = 0;
-		ps->on_ground = 1;
+		p->y = levelh*blockwidth - plw;
+		p->yv = 0;
+		p->on_ground = 1;
 	}
 
-	int xover = fmod(ps->plx, blockwidth) + plw > blockwidth;
-	int yover = fmod(ps->ply, blockwidth) + plw > blockwidth;
-	int b = block (ps->plx, ps->ply, levelw);
-	if (gr_is_pressed_debounce ('h'))
-		fprintf (stderr, "%f %f %d\n", ps->plx, ps->ply, b);
-#define L(b) (level[b] == 'g')
+	int xover = fmod(p->x, blockwidth) + plw > blockwidth;
+	int yover = fmod(p->y, blockwidth) + plw > blockwidth;
+	int b = block (p->x, p->y, levelw);
+	if (live && gr_is_pressed_debounce (ls->en->gr, 'h'))
+		fprintf (stderr, "%f %f %d\n", p->x, p->y, b);
+#define L(b) (TILE(level[b])->flags & TT_SOLID)
 	int A = L(b), B = (xover && L(b+1)),
 		C = (yover && L(b+levelw)), D = (xover && yover && L(b+levelw+1));
 #undef L
 
 	int shouldprojx = 0, shouldprojy = 0;
-	float xproj = ((ps->plxv < 0) ? plw : 0) - fmod (ps->plx + plw, blockwidth);
-	float yproj = ((ps->plyv < 0) ? plw : 0) - fmod (ps->ply + plw, blockwidth);
+	float xproj = ((p->xv < 0) ? plw : 0) - fmod (p->x + plw, blockwidth);
+	float yproj = ((p->yv < 0) ? plw : 0) - fmod (p->y + plw, blockwidth);
 	if (A && B && C && D)
 		return;
 	else if (A+B+C+D == 0)
@@ -245,17 +279,17 @@ void check_collisions (struct PlayerState *ps, struct LevelState *ls)
 		shouldprojx = xover;
 		shouldprojy = yover;
 	}
-	else if (ps->plxv >= 0 && (A || C))
+	else if (p->xv >= 0 && (A || C))
 		shouldprojy = 1;
-	else if (ps->plxv <= 0 && (B || D))
+	else if (p->xv <= 0 && (B || D))
 		shouldprojy = 1;
-	else if (ps->plyv >= 0 && (A || B))
+	else if (p->yv >= 0 && (A || B))
 		shouldprojx = 1;
-	else if (ps->plyv <= 0 && (C || D))
+	else if (p->yv <= 0 && (C || D))
 		shouldprojx = 1;
 	else
 	{
-		if (abs(xproj*ps->plyv) > abs(yproj*ps->plxv))
+		if (abs(xproj*p->yv) > abs(yproj*p->xv))
 			shouldprojy = 1;
 		else
 			shouldprojx = 1;
@@ -263,15 +297,86 @@ void check_collisions (struct PlayerState *ps, struct LevelState *ls)
 
 	if (shouldprojx)
 	{
-		ps->plx += xproj;
-		ps->plxv = 0;
+		p->x += xproj;
+		p->xv = 0;
 	}
 	if (shouldprojy)
 	{
-		ps->ply += yproj;
-		ps->plyv = 0;
+		p->y += yproj;
+		p->yv = 0;
 		if (yproj < 0)
-			ps->on_ground = 1;
+			p->on_ground = 1;
+	}
+}
+
+/* jiggle a player and its velocity to stop overlaps between it and the level.
+ * Overlaps are only worked out right if the player moved less than a tile,
+ * so one that moved more than maxvel this frame is taken back and moved
+ * again in that many substeps, checking after each */
+void check_collisions (struct PlayerState *ps, struct LevelState *ls)
+{
+	struct TrSample tr;
+	tr_begin (&tr);
+	struct Body p = bd_get (&ls->bodies, ps->id);
+	float speed = fmaxf (fabsf (p.xv), fabsf (p.yv));
+	if (speed <= maxvel)
+		resolve_collisions (&p, ps->plw, ps->rec.curinput == -1, ls);
+	else
+	{
+		float steps = ceilf (speed/maxvel);
+		int i, n = steps < MAX_SUBSTEPS ? steps : MAX_SUBSTEPS;
+		p.x -= p.xv;
+		p.y -= p.yv;
+		for (i = 0; i < n; ++ i)
+		{
+			// a wall or floor hit on the way stops that part of the motion
+			p.x += p.xv/n;
+			p.y += p.yv/n;
+			resolve_collisions (&p, ps->plw, ps->rec.curinput == -1, ls);
+		}
+	}
+	bd_set (&ls->bodies, ps->id, &p);
+	tr_end ("check_collisions", &tr);
+}
+
+// tiles of its own for a level about to change one, if it shares them with a fork
+static void ls_own_tiles (struct LevelState *ls)
+{
+	char *level = ls->level;
+	if (SDL_AtomicGet (ls->tiles_shared) > 1)
+	{
+		ls->level = mm_alloc (MM_LEVEL, strlen (level) + 1);
+		strcpy (ls->level, level);
+	}
+	if (ls_release (&ls->tiles_shared) && ls->level != level)
+		mm_free (level); // the others went meanwhile
+}
+
+// change one tile, noting the old value in the undo log
+void ls_set_tile (struct LevelState *ls, int b, char c)
+{
+	if (ls->level[b] == c)
+		return;
+	if (ls->tiles_shared)
+		ls_own_tiles (ls);
+	struct TileChange tc = {b, ls->level[b], c};
+	v_push (ls->undo, &tc);
+	ls->tile_hash ^= hc_tile (b, ls->level[b]) ^ hc_tile (b, c);
+	ls->level[b] = c;
+}
+
+// undo tile changes until the log is back to a given length
+void ls_rollback (struct LevelState *ls, int mark)
+{
+	Vector undo = ls->undo;
+	if (ls->tiles_shared && undo->len > mark)
+		ls_own_tiles (ls);
+	while (undo->len > mark)
+	{
+		struct TileChange *tc = v_at (undo, undo->len - 1);
+		ls->tile_hash ^= hc_tile (tc->b, tc->to) ^ hc_tile (tc->b, tc->from);
+		ls->level[tc->b] = tc->from;
+		-- undo->len;
 	}
 }
 
@@ -279,8 +384,11 @@ void check_collisions (struct PlayerState *ps, struct LevelState *ls)
 void ls_use_ctrl (struct LevelState *ls, char id)
 {
 	int i;
-	char *level = ls->level;
-	char *ctrl = ls->ctrl;
+	char *ctrl = ls->ctrl; // but not level, which ls_set_tile may move off a fork's tiles
+	struct TrSample tr;
+	if (id - '1' >= strlen (ls->action))
+		return; // the level has no such lever (a remote press of one, say)
+	tr_begin (&tr);
 	// find all blocks in level under control of our lever
 	if (ls->action[id-'1'] == 'f') // flip-flop
 	{
@@ -288,14 +396,10 @@ void ls_use_ctrl (struct LevelState *ls, char id)
 		{
 			if (ctrl[i] != id) // only care about things under control
 				continue;
-			switch (level[i])
-			{
-				// swap air with ground, and on-lever with off-lever
-				case 'a': level[i] = 'g'; break;
-				case 'g': level[i] = 'a'; break;
-				case 'l': level[i] = 'L'; break;
-				case 'L': level[i] = 'l'; break;
-			}
+			// swap air with ground, and on-lever with off-lever
+			char to = TILE(ls->level[i])->flip;
+			if (to)
+				ls_set_tile (ls, i, to);
 		}
 	}
 	else if (ls->action[id-'1'] == 'p') // permanent
@@ -304,22 +408,16 @@ void ls_use_ctrl (struct LevelState *ls, char id)
 		{
 			if (ctrl[i] == '0')
 				continue;
+			char to = 0;
 			if (ctrl[i] == (id^3))
-			{
-				if (level[i] == 'a')
-					level[i] = 'g';
-				else if (level[i] == 'l')
-					level[i] = 'L';
-			}
+				to = TILE(ls->level[i])->on;
 			else if (ctrl[i] == id)
-			{
-				if (level[i] == 'g')
-					level[i] = 'a';
-				else if (level[i] == 'L')
-					level[i] = 'l';
-			}
+				to = TILE(ls->level[i])->off;
+			if (to)
+				ls_set_tile (ls, i, to);
 		}
 	}
+	tr_end ("ls_use_ctrl", &tr);
 }
 
 // attempt to activate a lever at a location
@@ -327,11 +425,57 @@ void ls_lever (struct LevelState *ls, int b)
 {
 	char *level = ls->level;
 	char *ctrl = ls->ctrl;
-	if (level[b] != 'l' && level[b] != 'L')
+	if (!(TILE(level[b])->flags & TT_LEVER))
 		return;
 	ls_use_ctrl (ls, ctrl[b]);
 }
 
+/* reads a player's input into the bodies' move/jump arrays and activates levers,
+ * ready for bd_integrate; returns -1 if dead, 0 otherwise */
+int ps_input (struct LevelState *ls, struct PlayerState *ps)
+{
+	struct Bodies *bd = &ls->bodies;
+	int i = ps->id;
+	bd->active[i] = 0;
+	bd->xv[i] = 0;
+	int b = ps->tile = block (bd->x[i], bd->y[i], ls->levelw); // location
+	if (TILE(ls->level[b])->flags & TT_HAZARD) // on spikes; die
+		return -1;
+	// deal with input:
+	struct PlayerRecording *rec = &(ps->rec);
+	struct Graphics *gr = ls->en->gr;
+	float move = 0;
+	if (rec_isdown(gr, rec, 'd'))
+		move += 1;
+	if (rec_isdown(gr, rec, 'a'))
+		move -= 1;
+	bd->move[i] = move;
+	bd->jump[i] = rec_isdown(gr, rec, 'w'); // only if on ground
+	if (rec_isdown_debounce(gr, rec, '.'))
+	{
+		if (ls->update == LS_TWO_PHASE)
+			ps->lever = b; // pulled once everyone has moved
+		else
+			ls_lever (ls, b);
+	}
+	bd->active[i] = 1;
+	return 0;
+}
+
+/* once a player has been moved by bd_integrate: adjusts for collisions and finishes input
+ * return values as for next_player_state */
+int ps_finish (struct LevelState *ls, struct PlayerState *ps)
+{
+	int b = ps->tile;
+	check_collisions (ps, ls);
+	int state = rec_finishframe (ls->en->gr, &ps->rec);
+	if (state == 3 && !(TILE(ls->level[b])->flags & TT_GOAL)) // can only finish on goal square
+		state = 0;
+	else if (state == 2 && ls->cantravel && ls->cantravel[b%ls->levelw] == '0')
+		state = 0;
+	return state;
+}
+
 /* moves player/activates levers etc according to input, then adjusts for collisions and finishes input
  * return values:
  * -1: dead or paradox, complete restart;
@@ -341,310 +485,575 @@ void ls_lever (struct LevelState *ls, int b)
  * 3: finished level */
 int next_player_state (struct LevelState *ls, struct PlayerState *ps)
 {
-	ps->plxv = 0;
-	int b = block (ps->plx, ps->ply, ls->levelw); // location
-	if (ls->level[b] == 's') // on spikes; die
-		return -1;
-	// deal with input:
-	struct PlayerRecording *rec = &(ps->rec);
-	if (rec_isdown(rec, 'd'))
-		ps->plxv += movevel;
-	if (rec_isdown(rec, 'a'))
-		ps->plxv -= movevel;
-	if (rec_isdown(rec, 'w') && ps->on_ground)
-		ps->plyv = jumpvel;
-	if (rec_isdown_debounce(rec, '.'))
-		ls_lever (ls, b);
-	// adjust:
-	ps->plyv += const_grav; // gravity (positive y is downwards)
-	if (ps->plxv < -maxvel) ps->plxv = -maxvel;
-	if (ps->plxv >  maxvel) ps->plxv =  maxvel;
-	if (ps->plyv < -maxvel) ps->plyv = -maxvel;
-	if (ps->plyv >  maxvel) ps->plyv =  maxvel;
-	ps->plx += ps->plxv;
-	ps->ply += ps->plyv;
-	ps->on_ground = 0;
-	// collisions and input:
-	check_collisions (ps, ls);
-	int state = rec_finishframe (rec);
-	if (state == 3 && ls->level[b] != '*') // can only finish on goal square
-		state = 0;
-	else if (state == 2 && ls->cantravel && ls->cantravel[b%ls->levelw] == '0')
-		state = 0;
+	struct TrSample tr;
+	tr_begin (&tr);
+	int state = -1;
+	if (!ps_input (ls, ps))
+	{
+		bd_integrate (&ls->bodies, ps->id, ps->id + 1, ls->maxvel);
+		state = ps_finish (ls, ps);
+	}
+	tr_end ("next_player_state", &tr);
 	return state;
 }
 
-#define PIXEL_VALUE(a,b,c) (((a)<<16) | ((b)<<8) | ((c)<<0) | 0xFF000000)
-void draw_level (struct LevelState *ls)
+// rows [b*gr_ph/n, (b+1)*gr_ph/n) of a frame split into n bands
+struct Bands
+{
+	struct LevelState *ls;
+	int n;
+};
+
+// draw everything that falls in one band of the framebuffer
+static void draw_band (void *arg, int b)
 {
-	int w, x, y;
+	struct Bands *bn = arg;
+	struct LevelState *ls = bn->ls;
+	struct Graphics *gr = ls->en->gr;
+	int w, y;
+	int top = b*gr->ph/bn->n, bottom = (b+1)*gr->ph/bn->n;
+	struct PfSample pf;
+	struct TrSample tr;
+	pf_begin (&pf);
+	tr_begin (&tr);
 	char *level = ls->level;
 	int levelw = ls->levelw;
-	for (y = 0; y < gr_ph; ++ y)
-	{
-		int colour = PIXEL_VALUE(255,255,y<gr_ph/2 ? 255-2*(y*255)/gr_ph : 0);
-		for (x = 0; x < gr_pw; ++ x)
-			gr_pixels[y*gr_pw + x] = colour;
-	}
+	// world pixels to framebuffer pixels
+	float sx = (float) gr->pw / gr->vw, sy = (float) gr->ph / gr->vh;
+	for (y = top; y < bottom; ++ y)
+		gr_fill_rows (gr, top, bottom, y, 0, 1, gr->pw, PIXEL_VALUE(255,255,y<gr->ph/2 ? 255-2*(y*255)/gr->ph : 0));
 	for (w = 0; level[w]; ++ w)
 	{
 		float L = (w%levelw)*blockwidth, R = L + blockwidth,
 			U = (w/levelw)*blockwidth, D = U + blockwidth;
-		if (L >= ls->camx + gr_pw || R < ls->camx ||
-			U >= ls->camy + gr_ph || D < ls->camy)
+		if (L >= ls->camx + gr->vw || R < ls->camx ||
+			U >= ls->camy + gr->vh || D < ls->camy)
 			continue;
-		uint32_t val = 0;
-		if (level[w] == 'g')
-			val = PIXEL_VALUE(150, 100, 20);
-		else if (level[w] == 'l')
-			val = PIXEL_VALUE(100, 150, 100);
-		else if (level[w] == 'L')
-			val = PIXEL_VALUE(0, 200, 150);
-		else if (level[w] == 's')
-			val = PIXEL_VALUE(255, 0, 0);
-		else if (level[w] == '*')
-			val = PIXEL_VALUE(255, 200, 0);
-		else
+		uint32_t val = TILE(level[w])->colour;
+		if (!val)
 			continue;
-		for (y = 0; y < blockwidth; ++ y) for (x = 0; x < blockwidth; ++ x)
-		{
-			int X = x + (int)(L - ls->camx), Y = y + (int)(U - ls->camy);
-			if (X < 0 || X >= gr_pw ||
-				Y < 0 || Y >= gr_ph)
-				continue;
-			gr_pixels[Y*gr_pw + X] = val;
-		}
+		gr_fill_rows (gr, top, bottom, (int)((U - ls->camy)*sy), (int)((L - ls->camx)*sx),
+			(int)(blockwidth*sy), (int)(blockwidth*sx), val);
 	}
 	for (w = 0; w < ls->player_states->len; ++ w)
 	{
 		struct PlayerState *ps = v_at (ls->player_states, w);
 		if (!ps->extant)
 			continue;
-		for (y = 0; y < 50; ++ y) for (x = 0; x < 50; ++ x)
-		{
-			int X = x + (int) (ps->plx - ls->camx), Y = y + (int)(ps->ply - ls->camy);
-			if (X < 0 || X >= gr_pw ||
-				Y < 0 || Y >= gr_ph)
-				continue;
-			gr_pixels[Y*gr_pw + X] = PIXEL_VALUE(0,ps->rec.curinput==-1?100:0,0);
-		}
+		gr_fill_rows (gr, top, bottom, (int)((ls->bodies.y[ps->id] - ls->camy)*sy), (int)((ls->bodies.x[ps->id] - ls->camx)*sx),
+			(int)(50*sy), (int)(50*sx), PIXEL_VALUE(0,ps->rec.curinput==-1?100:0,0));
+	}
+	tr_end ("draw_band", &tr);
+	pf_end (PF_DRAW, &pf);
+}
+
+// read this frame's keys, from the keyboard or the journal being replayed
+static void ls_read_input (struct LevelState *ls)
+{
+	struct Engine *en = ls->en;
+	gr_update_events (en->gr);
+	if (en->replay)
+		jn_frame (en->replay, en->gr);
+	if (en->journal)
+		jn_frame (en->journal, en->gr);
+}
+
+// note something in the journal, and check it against the one being replayed
+static void ls_journal (struct Engine *en, const char *fmt, ...)
+{
+	if (!en->journal && !en->replay)
+		return;
+	char line[128];
+	va_list args;
+	va_start (args, fmt);
+	vsnprintf (line, sizeof(line), fmt, args);
+	va_end (args);
+	if (en->replay)
+		jn_event (en->replay, "%s", line);
+	if (en->journal)
+		jn_event (en->journal, "%s", line);
+}
+
+// queue the whole view as quads for the renderer to draw (GR_QUADS)
+static void draw_quads (struct LevelState *ls)
+{
+	struct Graphics *gr = ls->en->gr;
+	int w;
+	struct PfSample pf;
+	pf_begin (&pf);
+	// the same sky as draw_band: white fading to yellow halfway down
+	gr_quad (gr, 0, 0, gr->vh/2, gr->vw, PIXEL_VALUE(255,255,255), PIXEL_VALUE(255,255,0));
+	gr_quad (gr, gr->vh/2, 0, gr->vh - gr->vh/2, gr->vw, PIXEL_VALUE(255,255,0), PIXEL_VALUE(255,255,0));
+	for (w = 0; ls->level[w]; ++ w)
+	{
+		float L = (w%ls->levelw)*blockwidth, U = (w/ls->levelw)*blockwidth;
+		if (L >= ls->camx + gr->vw || L + blockwidth < ls->camx ||
+			U >= ls->camy + gr->vh || U + blockwidth < ls->camy)
+			continue;
+		uint32_t val = TILE(ls->level[w])->colour;
+		if (val)
+			gr_quad (gr, U - ls->camy, L - ls->camx, blockwidth, blockwidth, val, val);
+	}
+	for (w = 0; w < ls->player_states->len; ++ w)
+	{
+		struct PlayerState *ps = v_at (ls->player_states, w);
+		if (!ps->extant)
+			continue;
+		uint32_t val = PIXEL_VALUE(0,ps->rec.curinput==-1?100:0,0);
+		gr_quad (gr, ls->bodies.y[ps->id] - ls->camy, ls->bodies.x[ps->id] - ls->camx, 50, 50, val, val);
 	}
-	gr_refresh ();
-	gr_wait (1, 0);
-	gr_update_events ();
+	pf_end (PF_DRAW, &pf);
 }
 
-void new_player (struct LevelState *ls, const struct PlayerState *ps, int frame)
+// milliseconds since an SDL_GetPerformanceCounter reading
+static float ms_since (uint64_t t)
 {
-	struct PlayerState ps1 = {ps->plx, ps->ply, ps->plxv, ps->plyv, 0, 50, 1,
-		{ps->plx, ps->ply, ps->plxv, ps->plyv, frame,
-			v_dinit (sizeof(struct Keys)), {0,}, {0,}, 0, 0, 0, -1, 0}
+	return (SDL_GetPerformanceCounter () - t) * 1000.0 / SDL_GetPerformanceFrequency ();
+}
+
+// the frame number, ghosts still going and how long the last frame took, top left
+static void draw_hud (struct LevelState *ls)
+{
+	struct Engine *en = ls->en;
+	int i, ghosts = 0;
+	for (i = 0; i < ls->player_states->len; ++ i)
+	{
+		struct PlayerState *ps = v_at (ls->player_states, i);
+		ghosts += ps->extant && ps->rec.curinput >= 0;
+	}
+	char line[64];
+	sprintf (line, "FRAME %d  GHOSTS %d", ls->frame, ghosts);
+	gr_text (en->gr, 0, 0, line);
+	sprintf (line, "STEP %.2fMS  DRAW %.2fMS", en->step_ms, en->draw_ms);
+	gr_text (en->gr, en->gr->glyph_h, 0, line);
+}
+
+void draw_level (struct LevelState *ls)
+{
+	struct Graphics *gr = ls->en->gr;
+	struct TrSample tr;
+	tr_begin (&tr);
+	// nothing on screen has moved: keep the frame already there
+	uint64_t view = hc_view (ls, gr->vh, gr->vw);
+	if (view == ls->drawn && !ls->en->hud)
+	{
+		tr_end ("draw_level", &tr);
+		gr_idle_frame (gr);
+		ls_read_input (ls);
+		return;
+	}
+	ls->drawn = view;
+	uint64_t start = SDL_GetPerformanceCounter ();
+	gr_new_frame (gr);
+	if (gr->backend == GR_QUADS)
+		draw_quads (ls);
+	else
+	{
+		// tp_run returns once every band is done, so the frame is whole here
+		struct Bands bn = {ls, 4*tp_size (ls->pool)};
+		if (bn.n > gr->ph)
+			bn.n = gr->ph;
+		tp_run (ls->pool, bn.n, draw_band, &bn);
+	}
+	if (ls->en->hud)
+	{
+		draw_hud (ls);
+		ls->drawn = 0; // the HUD changes every frame, so this one can't be kept
+	}
+	tr_end ("draw_level", &tr);
+	gr_refresh (gr);
+	ls->en->draw_ms = ms_since (start); // with the upload and present
+	gr_wait (gr, 1, 0);
+	ls_read_input (ls);
+}
+
+void new_player (struct LevelState *ls, const struct Body *b, int frame)
+{
+	struct Body start = {b->x, b->y, b->xv, b->yv, 0};
+	struct PlayerState ps1 = {bd_add (&ls->bodies, &start), 50, 1,
+		{b->x, b->y, b->xv, b->yv, frame,
+			&ls->runs, ls->runs.len, 0, {0,}, {0,}, 0, 0, 0, -1, 0}
 	};
 	v_push (ls->player_states, &ps1);
 }
 
-/* return values:
- * -1: dead, restart level;
- * 0: quit entirely;
- * 1: playerless playback, and no players extant: success! (or skip level)
- * 2: player time travelled back;
- * 3: player finished level */
-int run_through_from_start (struct LevelState *ls, int can_remote)
+// centre the camera on a player, keeping it inside the level
+void ls_follow (struct LevelState *ls, struct PlayerState *ps)
+{
+	struct Body b = bd_get (&ls->bodies, ps->id);
+	int vh = ls->en->gr->vh, vw = ls->en->gr->vw;
+	ls->camx = b.x + ps->plw/2 - vw/2;
+	if (ls->camx < 0)
+		ls->camx = 0;
+	else if (ls->camx > ls->levelw*blockwidth - vw)
+		ls->camx = ls->levelw*blockwidth - vw;
+	ls->camy = b.y + ps->plw/2 - vh/2;
+	if (ls->camy < 0)
+		ls->camy = 0;
+	else if (ls->camy > ls->levelh*blockwidth - vh)
+		ls->camy = ls->levelh*blockwidth - vh;
+}
+
+// players [s*len/n, (s+1)*len/n) of a level split into n slices
+struct Slices
+{
+	struct LevelState *ls;
+	int n;
+};
+
+// first phase of a two-phase frame: move one slice of the players
+static void ls_move_slice (void *arg, int s)
 {
-	while (1) // loop through all frames
+	struct Slices *sl = arg;
+	Vector pss = sl->ls->player_states;
+	int i, start = s*pss->len/sl->n, end = (s+1)*pss->len/sl->n;
+	struct TrSample tr;
+	tr_begin (&tr);
+	for (i = start; i < end; ++ i)
 	{
-		if (can_remote)
+		struct PlayerState *ps = v_at (pss, i);
+		ps->lever = -1;
+		sl->ls->bodies.active[ps->id] = 0;
+		if (ps->extant)
+			ps->state = ps_input (sl->ls, ps);
+	}
+	bd_integrate (&sl->ls->bodies, start, end, sl->ls->maxvel);
+	for (i = start; i < end; ++ i)
+	{
+		struct PlayerState *ps = v_at (pss, i);
+		if (sl->ls->bodies.active[ps->id])
+			ps->state = ps_finish (sl->ls, ps);
+	}
+	tr_end ("ls_move_slice", &tr);
+}
+
+/* respond to input (recorded or live) for players [from, to) of a frame,
+ * counting those extant in *num_ext; returns as ls_step, or 0 to carry on */
+int ls_step_range (struct LevelState *ls, int from, int to, int *num_ext)
+{
+	int i;
+	for (i = from; i < to; ++ i)
+	{
+		struct PlayerState *ps = v_at (ls->player_states, i);
+		if (!ps->extant)
+			continue;
+		++ *num_ext;
+		int state = ls->update == LS_TWO_PHASE ? ps->state : next_player_state (ls, ps);
+		if (state == 1 && i < ls->player_states->len - 1)
 		{
-			if (gr_is_pressed_debounce ('1'))
-				ls_use_ctrl (ls, '1');
-			if (gr_is_pressed_debounce ('2'))
-				ls_use_ctrl (ls, '2');
+			// check matching pos+vel for end of cur player and start of next
+			struct PlayerState *nps = v_at (ls->player_states, i+1);
+			struct Body b = bd_get (&ls->bodies, ps->id);
+			if (b.x != nps->rec.i_plx || b.y != nps->rec.i_ply ||
+				b.xv != nps->rec.i_plxv || b.yv != nps->rec.i_plyv)
+			{
+				ls->paradox = 1;
+				return -1; // paradox!
+			}
 		}
-		if (gr_is_pressed_debounce (GRK_ESC))
-			return 0; // quit
-		if (gr_is_pressed_debounce ('r'))
-			return -1; // reset
-		if (gr_is_pressed_debounce ('='))
-			return 1; // skip
-
-		// most recent player is currently player, camera follows them:
-		struct PlayerState *ps = v_at (ls->player_states, ls->player_states->len-1);
-		ls->camx = ps->plx + ps->plw/2 - gr_pw/2;
-		if (ls->camx < 0)
-			ls->camx = 0;
-		else if (ls->camx > ls->levelw*blockwidth - gr_pw)
-			ls->camx = ls->levelw*blockwidth - gr_pw;
-		ls->camy = ps->ply + ps->plw/2 - gr_ph/2;
-		if (ls->camy < 0)
-			ls->camy = 0;
-		else if (ls->camy > ls->levelh*blockwidth - gr_ph)
-			ls->camy = ls->levelh*blockwidth - gr_ph;
-		
-		draw_level (ls);
-
-		// loop through players and respond to input (recorded or live)
-		int i, num_ext = 0;
+		if (state > 0)
+			ps->extant = 0;
+		if (state == -1 || state == 2 || state == 3)
+			return state;
+	}
+	return 0;
+}
+
+// loop through players once and respond to input (recorded or live)
+static int ls_step_players (struct LevelState *ls)
+{
+	int i, num_ext = 0, from = 0, state = 0;
+	++ ls->frame;
+	ls->frame_undo = ls->undo->len;
+	ls->paradox = 0;
+	if (ls->update == LS_TWO_PHASE)
+	{
+		// everyone moves against the level as it was at the start of the frame
+		struct Slices sl = {ls, 4*tp_size (ls->pool)};
+		if (sl.n > ls->player_states->len)
+			sl.n = ls->player_states->len;
+		tp_run (ls->pool, sl.n, ls_move_slice, &sl);
+		// then levers take effect in player order
 		for (i = 0; i < ls->player_states->len; ++ i)
 		{
 			struct PlayerState *ps = v_at (ls->player_states, i);
-			if (!ps->extant)
-				continue;
-			++ num_ext;
-			int state = next_player_state (ls, ps);
-			if (state == 1 && i < ls->player_states->len - 1)
+			if (ps->extant && ps->lever >= 0)
+				ls_lever (ls, ps->lever);
+		}
+	}
+	else if (ls->spec) // recorded players may have been moved already
+		from = sp_take (ls->spec, ls, &num_ext, &state);
+	if (!state)
+		state = ls_step_range (ls, from, ls->player_states->len, &num_ext);
+	if (ls->spec && !from)
+		sp_reseed (ls->spec, ls); // the worker guessed wrong: go again from here
+	if (state)
+		return state;
+	if (!num_ext) // no players left
+		return 1;
+	return 0;
+}
+
+/* simulate one frame
+ * return values:
+ * -1: dead or paradox;
+ * 0: normal, continue;
+ * 1: no players extant;
+ * 2: player time travelled back;
+ * 3: player finished level */
+int ls_step (struct LevelState *ls)
+{
+	struct PfSample pf;
+	pf_begin (&pf);
+	int state = ls_step_players (ls);
+	if (ls->hashes)
+		hc_record (ls);
+	pf_end (PF_STEP, &pf);
+	return state;
+}
+
+// how a run ended, as written to the journal; returns 1 for run_frame
+static int ls_ended (struct LevelState *ls, int *state, int s, const char *how)
+{
+	ls_journal (ls->en, "end %s", how);
+	*state = s;
+	return 1;
+}
+
+/* one frame of a run; returns 0 to carry on, or else the run is over with
+ * *state as for run_through_from_start: 1 if it ended before the frame was
+ * stepped (a key was pressed), 2 if it ended with the frame stepped */
+static int run_frame (struct LevelState *ls, int can_remote, int *state)
+{
+	struct Engine *en = ls->en;
+	struct PfSample pf;
+	struct TrSample tr;
+	pf_begin (&pf);
+	tr_begin (&tr);
+	if (can_remote)
+	{
+		char id;
+		for (id = '1'; id < '1' + REMOTE_LEVERS; ++ id)
+			if (gr_is_pressed_debounce (en->gr, id))
+			{
+				ls_journal (en, "remote %c", id);
+				ls_use_ctrl (ls, id);
+			}
+		if (gr_is_pressed_debounce (en->gr, 'k'))
+		{
+			ls_journal (en, "save");
+			if (!en->quicksave)
 			{
-				// check matching pos+vel for end of cur player and start of next
-				struct PlayerState *nps = v_at (ls->player_states, i+1);
-				if (ps->plx != nps->rec.i_plx || ps->ply != nps->rec.i_ply ||
-					ps->plxv != nps->rec.i_plxv || ps->plyv != nps->rec.i_plyv)
-					return -1; // paradox!
+				en->quicksave = mm_alloc (MM_HISTORY, sizeof(struct SaveState));
+				*en->quicksave = (struct SaveState) {NULL, 0, 0};
 			}
-			if (state > 0)
-				ps->extant = 0;
-			if (state == -1 || state == 2 || state == 3)
-				return state;
+			ss_save (en->quicksave, ls);
 		}
-		if (!num_ext) // no players left
-			return 1;
+		if (gr_is_pressed_debounce (en->gr, 'l') && en->quicksave)
+			ls_journal (en, ss_restore (ls, en->quicksave->data, en->quicksave->len) ?
+				"load" : "load refused");
 	}
+	if (gr_is_pressed_debounce (en->gr, GRK_ESC))
+		return ls_ended (ls, state, 0, "quit");
+	if (gr_is_pressed_debounce (en->gr, 'r'))
+		return ls_ended (ls, state, -1, "reset");
+	if (gr_is_pressed_debounce (en->gr, '='))
+		return ls_ended (ls, state, 1, "skipped");
+	if (gr_is_pressed_debounce (en->gr, 'm'))
+		mm_report (stderr);
+	if (gr_is_pressed_debounce (en->gr, 'i'))
+		en->hud = !en->hud;
+
+	// most recent player is currently player, camera follows them:
+	ls_follow (ls, v_at (ls->player_states, ls->player_states->len-1));
+	draw_level (ls);
+	if (en->exporter)
+		ex_frame (en->exporter, en->gr->pixels);
+
+	uint64_t start = SDL_GetPerformanceCounter ();
+	int s = ls_step (ls);
+	en->step_ms = ms_since (start);
+	tr_end ("frame", &tr);
+	pf_end (PF_FRAME, &pf);
+	if (!s)
+		return 0;
+	ls_ended (ls, state, s, s == -1 ? (ls->paradox ? "paradox" : "died") :
+		s == 1 ? "done" : s == 2 ? "travelled" : "finished");
+	return 2;
+}
+
+// get ready to run a level through from the start
+static void run_begin (struct LevelState *ls, int can_remote)
+{
+	ls_journal (ls->en, can_remote ? "attempt %d" : "check %d", ls->player_states->len);
+	if (ls->en->speculate && ls->update == LS_SERIAL)
+		ls->spec = sp_start (ls);
+}
+
+static void run_end (struct LevelState *ls)
+{
+	if (ls->spec)
+		sp_stop (ls->spec);
+	ls->spec = NULL;
+}
+
+/* return values:
+ * -1: dead, restart level;
+ * 0: quit entirely;
+ * 1: playerless playback, and no players extant: success! (or skip level)
+ * 2: player time travelled back;
+ * 3: player finished level */
+int run_through_from_start (struct LevelState *ls, int can_remote)
+{
+	int state;
+	run_begin (ls, can_remote);
+	while (!run_frame (ls, can_remote, &state))
+		;
+	run_end (ls);
+	return state;
 }
 
 // reset player state to be played back as recording
-void ps_reset (struct PlayerState *ps)
+void ps_reset (struct LevelState *ls, struct PlayerState *ps)
 {
 	ps->rec.curinput = 0;
 	ps->rec.curframe = 0;
-	ps->plx = ps->rec.i_plx;
-	ps->ply = ps->rec.i_ply;
-	ps->plxv = ps->rec.i_plxv;
-	ps->plyv = ps->rec.i_plyv;
-	ps->on_ground = 0;
+	struct Body b = {ps->rec.i_plx, ps->rec.i_ply, ps->rec.i_plxv, ps->rec.i_plyv, 0};
+	bd_set (&ls->bodies, ps->id, &b);
 	ps->extant = 1;
 }
 
-const char *initlevel, *control, *cantravel, *action;
-int levelw;
-float i_plx, i_ply;
+// reset tiles and players to how they were at the start of the level
+void ls_reset (struct LevelState *ls)
+{
+	ls_rollback (ls, 0); // only touches tiles that levers changed
+	ls->frame = 0;
+	if (ls->hashes)
+		ls->hashes->len = 0;
+	int i;
+	for (i = 0; i < ls->player_states->len; ++ i)
+		ps_reset (ls, v_at (ls->player_states, i));
+}
 
-void setup_2 ()
+void setup_2 (struct Setup *s)
 {
-	initlevel =
+	s->initlevel =
 	"aaaaa"
 	"aaaaa"
 	"aaaa*"
 	"ggagg"
 	"ggsgg"
 	"ggggg";
-	control =
+	s->control =
 	"00000"
 	"00000"
 	"00000"
 	"00000"
 	"00000"
 	"00000";
-	cantravel = NULL;
-	action = "";
-	levelw = 5;
-	i_plx = 100;
-	i_ply = 100;
+	s->cantravel = NULL;
+	s->action = "";
+	s->levelw = 5;
+	s->i_plx = 100;
+	s->i_ply = 100;
 }
 
-void setup_1 ()
+void setup_1 (struct Setup *s)
 {
-	initlevel =
+	s->initlevel =
 	"aaaaaa"
 	"aaaaaa"
 	"alaaa*"
 	"ggaagg"
 	"ggssgg"
 	"gggggg";
-	control =
+	s->control =
 	"000000"
 	"000000"
 	"010000"
 	"001100"
 	"000000"
 	"000000";
-	cantravel = NULL;
-	action = "f";
-	levelw = 6;
-	i_plx = 100;
-	i_ply = 100;
+	s->cantravel = NULL;
+	s->action = "f";
+	s->levelw = 6;
+	s->i_plx = 100;
+	s->i_ply = 100;
 }
 
-void setup0 ()
+void setup0 (struct Setup *s)
 {
-	initlevel =
+	s->initlevel =
 	"aaaaaa"
 	"aaaaaa"
 	"aaaal*"
 	"ggaagg"
 	"ggssgg"
 	"gggggg";
-	control =
+	s->control =
 	"000000"
 	"000000"
 	"000010"
 	"001100"
 	"000000"
 	"000000";
-	cantravel = NULL;
-	action = "f";
-	levelw = 6;
-	i_plx = 100;
-	i_ply = 100;
+	s->cantravel = NULL;
+	s->action = "f";
+	s->levelw = 6;
+	s->i_plx = 100;
+	s->i_ply = 100;
 }
 
-void setup1 ()
+void setup1 (struct Setup *s)
 {
-	initlevel =
+	s->initlevel =
 	"aaaaaaaaaaa"
 	"aaaaaaaaaaa"
 	"aaaalaaaal*"
 	"ggaagggaagg"
 	"ggssgggssgg"
 	"ggggggggggg";
-	control =
+	s->control =
 	"00000000000"
 	"00000000000"
 	"00001000020"
 	"00110002200"
 	"00000000000"
 	"00000000000";
-	cantravel = NULL;
-	action = "ff";
-	levelw = 11;
-	i_plx = 100;
-	i_ply = 100;
+	s->cantravel = NULL;
+	s->action = "ff";
+	s->levelw = 11;
+	s->i_plx = 100;
+	s->i_ply = 100;
 }
 
-void setuptoby ()
+void setuptoby (struct Setup *s)
 {
-	initlevel =
+	s->initlevel =
 	"aaaaaaaaaaa"
 	"aaaaaaaaaaa"
 	"aLaaaaaaal*"
 	"gggggggaagg"
 	"ggssgggssgg"
 	"ggggggggggg";
-	control =
+	s->control =
 	"00000000000"
 	"00000000000"
 	"02000000010"
 	"00220001100"
 	"00000000000"
 	"00000000000";
-	cantravel =
+	s->cantravel =
 	"00110001111";
-	action = "pp";
-	levelw = 11;
-	i_plx = 100;
-	i_ply = 100;
+	s->action = "pp";
+	s->levelw = 11;
+	s->i_plx = 100;
+	s->i_ply = 100;
 }
 
-void setup2 ()
+void setup2 (struct Setup *s)
 {
-	initlevel =
+	s->initlevel =
 	"aaaaaaaaaaaaa"
 	"aaaaaaaaaaaaa"
 	"aaaaagaaaaaaa"
@@ -652,7 +1061,7 @@ void setup2 ()
 	"gaaaggaagaagg"
 	"ggaaaaaggssgg"
 	"ggggggggggggg";
-	control =
+	s->control =
 	"0000000000000"
 	"0000000000000"
 	"0000000000000"
@@ -660,115 +1069,636 @@ void setup2 ()
 	"0002000001100"
 	"0000000000000"
 	"0000000000000";
-	cantravel = NULL;
-	action = "ff";
-	levelw = 13;
-	i_plx = 50;
-	i_ply = 220;
+	s->cantravel = NULL;
+	s->action = "ff";
+	s->levelw = 13;
+	s->i_plx = 50;
+	s->i_ply = 220;
 }
 
-void setup3 ()
+void setup3 (struct Setup *s)
 {
-	initlevel =
+	s->initlevel =
 	"aaaaaaaaaaa"
 	"aaaaaaaaaaa"
 	"aaaalaaaaa*"
 	"ggaaggggggg"
 	"ggssgggssgg"
 	"ggggggggggg";
-	control =
+	s->control =
 	"00000000000"
 	"00000000000"
 	"00001000000"
 	"00110001100"
 	"00000000000"
 	"00000000000";
-	cantravel = NULL;
-	action = "ff";
-	levelw = 11;
-	i_plx = 100;
-	i_ply = 100;
+	s->cantravel = NULL;
+	s->action = "ff";
+	s->levelw = 11;
+	s->i_plx = 100;
+	s->i_ply = 100;
 }
 
-void setup4 ()
+void setup4 (struct Setup *s)
 {
-	initlevel =
+	s->initlevel =
 	"aaaaaaaaaaa"
 	"aaaaaaaaaaa"
 	"aaaaaaaaal*"
 	"ggaaggggggg"
 	"ggssgggssgg"
 	"ggggggggggg";
-	control =
+	s->control =
 	"00000000000"
 	"00000000000"
 	"00000000010"
 	"00110001100"
 	"00000000000"
 	"00000000000";
-	cantravel = NULL;
-	action = "ff";
-	levelw = 11;
-	i_plx = 100;
-	i_ply = 100;
+	s->cantravel = NULL;
+	s->action = "ff";
+	s->levelw = 11;
+	s->i_plx = 100;
+	s->i_ply = 100;
 }
 
-int playlevel ()
+void (*setups[]) (struct Setup *) = {setup_2, setup_1, setup0, setup1, setuptoby, setup2, setup3, setup4};
+const int num_setups = sizeof(setups)/sizeof(*setups);
+
+struct LevelState *start_level (struct Engine *en, const struct Setup *setup)
 {
-	struct LevelState *ls = ls_init (initlevel, control, cantravel, action, levelw); // set up level
-	struct PlayerState ips = {i_plx, i_ply, 0, 0, }; // initial player pos+vel
+	struct LevelState *ls = ls_init (en, setup); // set up level
+	ls->update = en->update_mode;
+	ls->pool = en->pool;
+	ls->maxvel = en->maxvel;
+	if (en->hashing)
+		ls->hashes = v_dinit (sizeof(uint64_t), MM_HISTORY);
+	return ls;
+}
 
-	int state = 0;
-	while (state != 3) // while not finished level
+// write the recordings of a verified level to <save_prefix><level>.sol
+void save_solution (struct LevelState *ls)
+{
+	struct Engine *en = ls->en;
+	char path[strlen (en->save_prefix) + 16];
+	sprintf (path, "%s%d.sol", en->save_prefix, en->curlevel);
+	FILE *f = fopen (path, "w");
+	if (!f)
+	{
+		fprintf (stderr, "Can't write %s\n", path);
+		return;
+	}
+	fprintf (f, "timetravel-solution 1\nlevel %d\n", en->curlevel);
+	if (ls->maxvel != maxvel)
+		fprintf (f, "maxvel %a\n", ls->maxvel);
+	rp_write (f, ls);
+	if (ls->hashes)
+		hc_write (f, ls->hashes);
+	fclose (f);
+}
+
+/* set up the level a solution is for, with its recordings ready to play;
+ * *hashes gets its hash chain if it was saved with one */
+struct LevelState *load_solution (struct Engine *en, const char *path, Vector *hashes)
+{
+	FILE *f = fopen (path, "r");
+	if (!f)
+		return NULL;
+	int version, n;
+	struct LevelState *ls = NULL;
+	if (fscanf (f, " timetravel-solution %d level %d", &version, &n) == 2 &&
+		version == 1 && n >= 0 && n < num_setups)
 	{
-		new_player (ls, &ips, 0); // make new player with given starting params
-		state = run_through_from_start (ls, 1); // play thru with all players
-		if (state <= 1) // -1 restart level; 0 quit game; 1 next level
+		en->curlevel = n;
+		setups[n](&en->setup);
+		ls = start_level (en, &en->setup);
+		ls->maxvel = maxvel; // unless the solution says otherwise
+		fscanf (f, " maxvel %a", &ls->maxvel);
+		int read = ls->maxvel > 0 && ls->maxvel <= MAX_SUBSTEPS*maxvel && rp_read (f, ls);
+		if (read)
+			*hashes = hc_read (f);
+		fscanf (f, " ");
+		if (!read || !feof (f)) // malformed, or something after the hashes
 		{
 			ls_free (ls);
-			return state;
+			ls = NULL;
+			if (*hashes)
+				v_free (*hashes);
+			*hashes = NULL;
 		}
-		
+	}
+	fclose (f);
+	return ls;
+}
+
+// print everything that goes into a frame's hash
+void dump_state (struct LevelState *ls)
+{
+	int i;
+	fprintf (stderr, "frame %d:\n", ls->frame);
+	for (i = 0; i < ls->player_states->len; ++ i)
+	{
+		struct PlayerState *ps = v_at (ls->player_states, i);
+		struct Body b = bd_get (&ls->bodies, ps->id);
+		fprintf (stderr, "  player %d: %s pos (%a, %a) vel (%a, %a)%s\n", i,
+			ps->extant ? "extant" : "gone", b.x, b.y, b.xv, b.yv, b.on_ground ? " on ground" : "");
+	}
+	for (i = 0; i < ls->levelh; ++ i)
+		fprintf (stderr, "  %.*s\n", ls->levelw, ls->level + i*ls->levelw);
+}
+
+#ifdef CHECK_FORKS
+// a fork of ls with a hash chain carrying on from ls's
+static struct LevelState *check_fork (struct LevelState *ls)
+{
+	struct LevelState *f = ls_fork (ls);
+	f->hashes = v_dinit (sizeof(uint64_t), MM_HISTORY);
+	if (ls->hashes->len)
+		v_push (f->hashes, v_at (ls->hashes, ls->hashes->len - 1));
+	return f;
+}
+#endif
+
+/* run a saved solution without drawing and compare its hash chain with the
+ * saved one, describing the first frame that differs. Built with
+ * -DCHECK_FORKS, the level is also forked half way through and the fork run
+ * on to the end, which must go exactly the same way
+ * return values as for run_through_from_start */
+int check_solution (const char *path, struct LevelState *ls, Vector expected)
+{
+	int state = 0, diverged = 0;
+#ifdef CHECK_FORKS
+	int mid = expected ? expected->len/2 : 0;
+	struct LevelState *fork = NULL;
+#endif
+	while (!state)
+	{
+		struct PfSample pf;
+		struct TrSample tr;
+#ifdef CHECK_FORKS
+		if (ls->frame == mid && !fork)
+			fork = check_fork (ls);
+#endif
+		pf_begin (&pf);
+		tr_begin (&tr);
+		state = ls_step (ls);
+		tr_end ("frame", &tr);
+		pf_end (PF_FRAME, &pf);
+	}
+#ifdef CHECK_FORKS
+	if (fork)
+	{
+		int fork_state = 0;
+		while (!fork_state)
+			fork_state = ls_step (fork);
+		// each hash covers every frame before it
+		if (fork_state != state || fork->frame != ls->frame || *(uint64_t *) v_at (fork->hashes,
+			fork->hashes->len - 1) != *(uint64_t *) v_at (ls->hashes, ls->hashes->len - 1))
+		{
+			fprintf (stderr, "%s: a fork from frame %d went differently\n", path, mid);
+			diverged = 1;
+		}
+		ls_free (fork);
+	}
+#endif
+	if (!expected)
+		fprintf (stderr, "%s: no hashes saved with this solution\n", path);
+	else
+	{
+		int f = hc_diverge (ls->hashes, expected);
+		if (f < 0)
+			fprintf (stderr, "%s: all %d frames match\n", path, expected->len);
+		else
+		{
+			// hashes[f] is the state after frame f+1
+			fprintf (stderr, "%s: first differs after frame %d (of %d saved, %d now)\n",
+				path, f+1, expected->len, ls->hashes->len);
+			struct Replay *rp = rp_init (ls);
+			rp_seek (rp, f);
+			dump_state (ls);
+			rp_seek (rp, f+1);
+			dump_state (ls);
+			rp_free (rp);
+			diverged = 1;
+		}
+		v_free (expected);
+	}
+	if (state == -1)
+		fprintf (stderr, "%s: player died or caused a paradox\n", path);
+	ls_free (ls);
+	return diverged ? -1 : state;
+}
+
+/* play back a saved solution, rendering it to <path>.ppm/.y4m if exporting
+ * return values as for run_through_from_start */
+int play_solution (struct Engine *en, const char *path)
+{
+	Vector expected = NULL;
+	struct LevelState *ls = load_solution (en, path, &expected);
+	if (!ls)
+	{
+		fprintf (stderr, "%s: not a solution\n", path);
+		return -1;
+	}
+	if (en->checking)
+		return check_solution (path, ls, expected);
+	if (en->export_format >= 0)
+	{
+		char out[strlen (path) + 5];
+		sprintf (out, "%s.%s", path, en->export_format == EX_Y4M ? "y4m" : "ppm");
+		en->exporter = ex_open (out, en->gr->ph, en->gr->pw, en->export_format);
+		if (!en->exporter)
+			fprintf (stderr, "Can't write %s\n", out);
+	}
+	int state = run_through_from_start (ls, 0);
+	if (en->exporter && !ex_close (en->exporter))
+		fprintf (stderr, "%s: export failed\n", path);
+	en->exporter = NULL;
+	if (state == -1)
+		fprintf (stderr, "%s: player died or caused a paradox\n", path);
+	if (expected)
+		v_free (expected);
+	ls_free (ls);
+	return state;
+}
+
+/* done with a level: on to the next if state is 1, the same one again if
+ * -1, or stop if 0 */
+static void gm_leave (struct Game *gm, int state)
+{
+	ls_free (gm->ls);
+	gm->ls = NULL;
+	if (!state)
+		gm->phase = GM_OVER;
+	else
+	{
+		if (state == 1) // solved or skipped; otherwise try the level again
+			++ gm->en->curlevel;
+		gm->phase = GM_LEVEL;
+	}
+}
+
+// a level set up on another thread, ready to be swapped in when the game gets to it
+struct Preload
+{
+	struct Engine *en;
+	int level; // index into setups
+	struct Setup setup;
+	struct LevelState *ls;
+	SDL_Thread *thread;
+};
+
+static int preload_level (void *data)
+{
+	struct Preload *pl = data;
+	setups[pl->level](&pl->setup);
+	struct LevelState *ls = pl->ls = start_level (pl->en, &pl->setup);
+	// make the first frame's allocations now: a player's body and their first key runs
+	struct Body b = {0,};
+	struct Keys k = {{0,}, 0};
+	bd_add (&ls->bodies, &b);
+	ls->bodies.len = 0;
+	kr_push (&ls->runs, &k);
+	ls->runs.len = 0;
+	return 0;
+}
+
+// start setting up level n while the current one is checked
+static void gm_preload (struct Game *gm, int n)
+{
+	if (n >= num_setups || gm->next)
+		return;
+	struct Preload *pl = gm->next = mm_alloc (MM_OTHER, sizeof(struct Preload));
+	*pl = (struct Preload) {gm->en, n, {0,}, NULL, NULL};
+	pl->thread = SDL_CreateThread (preload_level, "preload", pl);
+}
+
+// wait for the preloaded level to be ready and take it
+static struct LevelState *gm_finish_preload (struct Game *gm)
+{
+	struct Preload *pl = gm->next;
+	SDL_WaitThread (pl->thread, NULL);
+	struct LevelState *ls = pl->ls;
+	mm_free (pl);
+	gm->next = NULL;
+	return ls;
+}
+
+/* the level about to be played, if it was preloaded; a preloaded level
+ * that isn't the one wanted (the check failed, say) is thrown away */
+static struct LevelState *gm_take_preload (struct Game *gm)
+{
+	struct Engine *en = gm->en;
+	if (!gm->next)
+		return NULL;
+	int level = gm->next->level;
+	struct Setup setup = gm->next->setup;
+	struct LevelState *ls = gm_finish_preload (gm);
+	if (level != en->curlevel)
+	{
+		ls_free (ls);
+		return NULL;
+	}
+	en->setup = setup;
+	return ls;
+}
+
+// a run is over (state as from run_through_from_start): work out what comes next
+static void gm_ended (struct Game *gm, int state)
+{
+	struct Engine *en = gm->en;
+	struct LevelState *ls = gm->ls;
+	if (gm->phase == GM_PLAY && (state == 2 || state == 3))
+	{
 		// next inital player state is current (live) player's final state:
 		struct PlayerState *ps = v_at (ls->player_states, ls->player_states->len - 1);
-		ips = (struct PlayerState) {ps->plx, ps->ply, ps->plxv, ps->plyv, };
-
+		gm->ips = bd_get (&ls->bodies, ps->id);
 		// reset level and player states before adding new player
-		strcpy (ls->level, ls->initlevel);
-		int i;
-		for (i = 0; i < ls->player_states->len; ++ i)
-			ps_reset (v_at (ls->player_states, i));
+		ls_reset (ls);
+		if (state == 2)
+			gm->phase = GM_ATTEMPT;
+		else
+		{
+			// level finished: final fully-recorded runthrough to check consistency
+			run_begin (ls, 0);
+			gm_preload (gm, en->curlevel + 1); // most likely next
+			gm->phase = GM_CHECK;
+		}
+		return;
 	}
-	// state == 3, level finished; everything reset
-	// final fully-recorded runthrough to check consistency:
-	state = run_through_from_start (ls, 0); // -1 restart (paradox); 0 quit; 1 success
-	ls_free (ls); // clean up
-	return state;
+	if (gm->phase == GM_CHECK && state == 1)
+	{
+		if (en->save_prefix)
+			save_solution (ls);
+		if (en->review)
+		{
+			// let the solution be inspected frame by frame
+			gm->rp = rp_init (ls);
+			gm->phase = GM_REVIEW;
+			return;
+		}
+	}
+	gm_leave (gm, state);
 }
 
-int repeatlevel ()
+/* move a game on by a frame, setting up whatever has to be set up before
+ * it; returns 0 once the game is over (quit, or every level done) */
+int gm_step (struct Game *gm)
 {
-	int status;
+	struct Engine *en = gm->en;
+	int state, ended;
 	while (1)
 	{
-		status = playlevel ();
-		if (status >= 0)
-			return status;
+		switch (gm->phase)
+		{
+			case GM_LEVEL:
+				if (en->curlevel >= num_setups)
+				{
+					gm->phase = GM_OVER;
+					break;
+				}
+				if (!(gm->ls = gm_take_preload (gm)))
+				{
+					setups[en->curlevel](&en->setup);
+					gm->ls = start_level (en, &en->setup);
+				}
+				ls_journal (en, "level %d", en->curlevel);
+				gm->ips = (struct Body) {en->setup.i_plx, en->setup.i_ply, 0, 0, }; // initial player pos+vel
+				gm->phase = GM_ATTEMPT;
+				break;
+
+			case GM_ATTEMPT:
+				new_player (gm->ls, &gm->ips, 0); // make new player with given starting params
+				run_begin (gm->ls, 1);
+				gm->phase = GM_PLAY;
+				break;
+
+			case GM_PLAY:
+			case GM_CHECK:
+				if (!(ended = run_frame (gm->ls, gm->phase == GM_PLAY, &state)))
+					return 1;
+				run_end (gm->ls);
+				gm_ended (gm, state);
+				if (ended == 2)
+					return 1; // that frame was this call's
+				break;
+
+			case GM_REVIEW:
+				state = rp_view_frame (gm->rp);
+				if (state < 0)
+					return 1;
+				rp_free (gm->rp);
+				gm->rp = NULL;
+				gm_leave (gm, state);
+				break;
+
+			case GM_OVER:
+				if (gm->next) // quit while the next level was being set up
+					ls_free (gm_finish_preload (gm));
+				return 0;
+		}
 	}
 }
 
-int main ()
+// give up on a game wherever it is
+void gm_free (struct Game *gm)
 {
-	gr_init (720, 1300);
-	void (*setups[]) (void) = {setup_2, setup_1, setup0, setup1, setuptoby, setup2, setup3, setup4};
-	int i;
-	for (i = 0; i < sizeof(setups)/sizeof(*setups); ++ i)
+	if (gm->rp)
+		rp_free (gm->rp);
+	if (gm->ls)
 	{
-		setups[i]();
-		if (!repeatlevel ())
-			return 0;
+		run_end (gm->ls);
+		ls_free (gm->ls);
 	}
-	return 0;
+	if (gm->next)
+		ls_free (gm_finish_preload (gm));
+	*gm = (struct Game) {gm->en, GM_OVER, NULL, {0,}, NULL, NULL};
+}
+
+// say what the region graph makes of each level; returns 1 if any can't be finished
+static int check_levels ()
+{
+	int i, j, failed = 0;
+	for (i = 0; i < num_setups; ++ i)
+	{
+		struct Setup s;
+		setups[i] (&s);
+		struct Reach *rg = rg_build (&s);
+		printf ("level %d: %d lever configurations%s, levers", i, rg_configs (rg), rg_complete (rg) ? "" : " or more");
+		for (j = 0; j < RG_LEVERS; ++ j)
+			if (rg_levers (rg) >> j & 1)
+				printf (" %d", j+1);
+		printf (rg_levers (rg) ? " can be pulled" : " none");
+		printf (", goal %s\n", rg_goal (rg) ? "reachable" : "unreachable");
+		failed |= !rg_goal (rg);
+		rg_free (rg);
+	}
+	return failed;
+}
+
+static void report_memory ()
+{
+	mm_report (stderr);
+}
+
+// the journals in use, so they're finished however the game exits
+static struct Journal *journal_open, *replay_open;
+
+static void close_journals ()
+{
+	if (journal_open && !jn_close (journal_open))
+		fprintf (stderr, "journal: write failed\n");
+	if (replay_open)
+		jn_close (replay_open);
+}
+
+// open the journals asked for on the command line once there's a Graphics to replay into
+static void open_journals (struct Engine *en, const char *write, const char *replay)
+{
+	if (replay && !(en->replay = jn_replay (replay, en->gr)))
+		fprintf (stderr, "%s: not a journal\n", replay);
+	if (write && !(en->journal = jn_open (write)))
+		fprintf (stderr, "Can't write %s\n", write);
+	journal_open = en->journal;
+	replay_open = en->replay;
+	atexit (close_journals);
+}
+
+// start tracing, if asked to; after gr_init, so the trace is finished before SDL_Quit
+static void open_trace (const char *path)
+{
+	if (path)
+		tr_init (path);
+}
+
+// saved solutions to check or export, each played by a session of its own
+struct Jobs
+{
+	struct Engine *en; // what each session copies its options from
+	char **files;
+	int *states;
+};
+
+static void play_job (void *arg, int i)
+{
+	struct Jobs *j = arg;
+	struct Engine en = *j->en;
+	struct Graphics *gr = j->en->gr;
+	en.gr = gr_init_headless (gr->vh, gr->vw, gr->scale);
+	en.pool = NULL; // the pool is busy running sessions
+	en.journal = en.replay = NULL;
+	j->states[i] = play_solution (&en, j->files[i]);
+	gr_free (en.gr);
+}
+
+int main (int argc, char **argv)
+{
+	int i, num_files = 0;
+	char **files = mm_alloc (MM_OTHER, sizeof(char *) * argc);
+	float scale = 1;
+	int backend = GR_PIXELS;
+	const char *journal = NULL, *replay = NULL, *trace = NULL;
+	int check = 0;
+	struct Engine en = {NULL, NULL, {0,}, 0, LS_SERIAL, 0, 0, NULL, 0, 0, -1, NULL, NULL, NULL, 0, 0, 0, maxvel, NULL};
+	for (i = 1; i < argc; ++ i)
+	{
+		if (!strcmp (argv[i], "-v"))
+			en.review = 1;
+		else if (!strcmp (argv[i], "-p"))
+			en.update_mode = LS_TWO_PHASE;
+		else if (!strcmp (argv[i], "-r") && i+1 < argc && atof (argv[i+1]) > 0)
+			scale = atof (argv[++i]);
+		else if (!strcmp (argv[i], "-V") && i+1 < argc && atof (argv[i+1]) > 0 && atof (argv[i+1]) <= MAX_SUBSTEPS*maxvel)
+			en.maxvel = atof (argv[++i]);
+		else if (!strcmp (argv[i], "-q"))
+			backend = GR_QUADS;
+		else if (!strcmp (argv[i], "-g"))
+			en.speculate = 1;
+		else if (!strcmp (argv[i], "-P"))
+			pf_init ();
+		else if (!strcmp (argv[i], "-M"))
+			atexit (report_memory);
+		else if (!strcmp (argv[i], "-t") && i+1 < argc)
+			trace = argv[++i];
+		else if (!strcmp (argv[i], "-a"))
+			check = 1;
+		else if (!strcmp (argv[i], "-s") && i+1 < argc)
+			en.save_prefix = argv[++i];
+		else if (!strcmp (argv[i], "-j") && i+1 < argc)
+			journal = argv[++i];
+		else if (!strcmp (argv[i], "-J") && i+1 < argc)
+			replay = argv[++i];
+		else if (!strcmp (argv[i], "-H"))
+			en.hashing = 1;
+		else if (!strcmp (argv[i], "-c"))
+			en.checking = en.hashing = 1;
+		else if (!strcmp (argv[i], "-e") && i+1 < argc && !strcmp (argv[i+1], "ppm"))
+			en.export_format = EX_PPM, ++i;
+		else if (!strcmp (argv[i], "-e") && i+1 < argc && !strcmp (argv[i+1], "y4m"))
+			en.export_format = EX_Y4M, ++i;
+		else if (argv[i][0] != '-')
+			files[num_files++] = argv[i];
+		else
+		{
+			mm_free (files);
+			fprintf (stderr, "usage: %s [-v] [-p] [-g] [-r scale] [-q] [-V maxvel] [-P] [-t trace] [-M] [-a] [-s prefix] [-j journal] [-J journal] [-H] [-c] [-e ppm|y4m] [solution...]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (check)
+	{
+		mm_free (files);
+		open_trace (trace);
+		return check_levels ();
+	}
+	int failed = 0;
+	en.pool = tp_init (0);
+	if (num_files && (en.export_format >= 0 || en.checking))
+	{
+		// check or render without a window: every solution at once, one per thread
+		en.gr = gr_init_headless (720, 1300, scale);
+		open_trace (trace);
+		struct Jobs j = {&en, files, mm_alloc (MM_OTHER, sizeof(int) * num_files)};
+		tp_run (en.pool, num_files, play_job, &j);
+		for (i = 0; i < num_files; ++ i)
+			failed |= j.states[i] < 0;
+		mm_free (j.states);
+	}
+	else if (num_files)
+	{
+		// play back saved solutions
+		en.gr = gr_init (720, 1300, scale, backend);
+		open_trace (trace);
+		open_journals (&en, journal, replay);
+		for (i = 0; i < num_files; ++ i)
+		{
+			int state = play_solution (&en, files[i]);
+			if (!state)
+				break;
+			failed |= state < 0;
+		}
+	}
+	else
+	{
+		en.gr = gr_init (720, 1300, scale, backend);
+		open_trace (trace);
+		open_journals (&en, journal, replay);
+		struct Game gm = {&en, GM_LEVEL, NULL, {0,}, NULL, NULL};
+		while (gm_step (&gm))
+			;
+		gm_free (&gm);
+		if (en.quicksave)
+		{
+			ss_free (en.quicksave);
+			mm_free (en.quicksave);
+		}
+	}
+	// the pool's threads first, as they draw into gr
+	tp_free (en.pool);
+	gr_free (en.gr);
+	mm_free (files);
+	return failed;
 }
 
 /* vim: set noexpandtab ts=4 sts=4 sw=4 : */
@@ -0,0 +1,92 @@
+#include "mem.h"
+
+#include "SDL.h"
+#include <stdlib.h>
+
+// in front of every block; padded so the block stays suitably aligned
+union MmHeader
+{
+	struct
+	{
+		size_t size;
+		int tag;
+	} h;
+	long double align;
+};
+
+struct MmStats
+{
+	size_t live, peak; // bytes
+	unsigned long allocs, reallocs, frees;
+};
+
+static const char *mm_names[MM_TAGS] = {"level", "recordings", "players", "history", "framebuffer", "other"};
+static struct MmStats mm_stats[MM_TAGS], mm_total;
+static SDL_SpinLock mm_lock = 0;
+
+/* account for a block of a tag growing by grow bytes (which may be
+ * negative) through an allocation, a reallocation or a free */
+static void mm_count (int tag, long grow, int alloc, int resized, int freed)
+{
+	struct MmStats *st[2] = {&mm_stats[tag], &mm_total};
+	int i;
+	SDL_AtomicLock (&mm_lock);
+	for (i = 0; i < 2; ++ i)
+	{
+		st[i]->live += grow;
+		if (st[i]->live > st[i]->peak)
+			st[i]->peak = st[i]->live;
+		st[i]->allocs += alloc;
+		st[i]->reallocs += resized;
+		st[i]->frees += freed;
+	}
+	SDL_AtomicUnlock (&mm_lock);
+}
+
+void *mm_alloc (int tag, size_t size)
+{
+	union MmHeader *m = malloc (sizeof(union MmHeader) + size);
+	m->h.size = size;
+	m->h.tag = tag;
+	mm_count (tag, size, 1, 0, 0);
+	return m + 1;
+}
+
+// like realloc; the block keeps the tag it was given first
+void *mm_realloc (int tag, void *p, size_t size)
+{
+	if (!p)
+		return mm_alloc (tag, size);
+	union MmHeader *m = (union MmHeader *) p - 1;
+	long grow = (long) size - (long) m->h.size;
+	m = realloc (m, sizeof(union MmHeader) + size);
+	m->h.size = size;
+	mm_count (m->h.tag, grow, 0, 1, 0);
+	return m + 1;
+}
+
+void mm_free (void *p)
+{
+	if (!p)
+		return;
+	union MmHeader *m = (union MmHeader *) p - 1;
+	mm_count (m->h.tag, - (long) m->h.size, 0, 0, 1);
+	free (m);
+}
+
+void mm_report (FILE *f)
+{
+	struct MmStats st[MM_TAGS + 1];
+	int i;
+	SDL_AtomicLock (&mm_lock);
+	for (i = 0; i < MM_TAGS; ++ i)
+		st[i] = mm_stats[i];
+	st[MM_TAGS] = mm_total;
+	SDL_AtomicUnlock (&mm_lock);
+	fprintf (f, "%-12s %12s %12s %10s %10s %10s\n", "memory", "live bytes", "peak bytes", "allocs", "reallocs", "frees");
+	for (i = 0; i <= MM_TAGS; ++ i)
+		fprintf (f, "%-12s %12zu %12zu %10lu %10lu %10lu\n", i < MM_TAGS ? mm_names[i] : "total",
+			st[i].live, st[i].peak, st[i].allocs, st[i].reallocs, st[i].frees);
+}
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
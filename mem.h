@@ -0,0 +1,31 @@
+#ifndef MEM_H_INCLUDED
+#define MEM_H_INCLUDED
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* Prefix mm_ is for memory accounting.
+ * Every allocation the game makes goes through mm_alloc/mm_realloc with a
+ * tag saying what it is for, and is given back with mm_free, so live and
+ * peak bytes, allocations and reallocations can be reported per tag at any
+ * time. Blocks carry a small header recording their size and tag. */
+
+enum
+{
+	MM_LEVEL,       // tiles, levers and the LevelState itself
+	MM_RECORDINGS,  // players' recorded keys
+	MM_PLAYERS,     // PlayerStates and Bodies
+	MM_HISTORY,     // undo logs, hash chains and replay snapshots
+	MM_FRAMEBUFFER, // pixels, and frames queued for export
+	MM_OTHER,
+	MM_TAGS
+};
+
+void *mm_alloc   (int, size_t);
+void *mm_realloc (int, void *, size_t);
+void  mm_free    (void *);
+void  mm_report  (FILE *);
+
+#endif /* MEM_H_INCLUDED */
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
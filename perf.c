@@ -0,0 +1,137 @@
+#include "perf.h"
+
+#include <stdio.h>
+
+#if defined(NO_PERF_COUNTERS) || !defined(__linux__)
+
+int pf_init ()
+{
+	fprintf (stderr, "Built without performance counters\n");
+	return 0;
+}
+
+#  ifndef NO_PERF_COUNTERS
+void pf_begin (struct PfSample *s) {}
+void pf_end (int r, struct PfSample *s) {}
+#  endif
+
+#else
+
+#include "SDL.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static const uint64_t pf_events[PF_EVENTS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES};
+static const char *pf_names[PF_REGIONS] = {"frame", "ls_step", "draw bands"};
+
+static int pf_on = 0;
+static SDL_mutex *pf_lock;
+static uint64_t pf_calls[PF_REGIONS], pf_totals[PF_REGIONS][PF_EVENTS];
+
+// this thread's group of counters: -1 if not opened yet, -2 if it can't be
+static __thread int pf_fd = -1;
+
+// open a group of PF_EVENTS counters for this thread, returning the leader
+static int pf_open ()
+{
+	int fds[PF_EVENTS], i;
+	for (i = 0; i < PF_EVENTS; ++ i)
+	{
+		struct perf_event_attr attr;
+		memset (&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = pf_events[i];
+		attr.disabled = !i; // the whole group starts together
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+		fds[i] = syscall (SYS_perf_event_open, &attr, 0, -1, i ? fds[0] : -1, 0);
+		if (fds[i] < 0)
+		{
+			int err = errno;
+			while (i --)
+				close (fds[i]);
+			errno = err;
+			return -2;
+		}
+	}
+	ioctl (fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return fds[0];
+}
+
+// current counter values for this thread; 0 if there aren't any
+static int pf_read (struct PfSample *s)
+{
+	if (pf_fd == -1)
+		pf_fd = pf_open ();
+	if (pf_fd < 0)
+		return 0;
+	uint64_t buf[1 + PF_EVENTS]; // number of counters, then their values
+	if (read (pf_fd, buf, sizeof(buf)) != sizeof(buf))
+		return 0;
+	memcpy (s->v, buf + 1, sizeof(s->v));
+	return 1;
+}
+
+void pf_begin (struct PfSample *s)
+{
+	if (pf_on)
+		pf_read (s);
+}
+
+void pf_end (int r, struct PfSample *s)
+{
+	struct PfSample now;
+	if (!pf_on || !pf_read (&now))
+		return;
+	int i;
+	SDL_LockMutex (pf_lock);
+	++ pf_calls[r];
+	for (i = 0; i < PF_EVENTS; ++ i)
+		pf_totals[r][i] += now.v[i] - s->v[i];
+	SDL_UnlockMutex (pf_lock);
+}
+
+static void pf_report ()
+{
+	int r;
+	fprintf (stderr, "%-12s %10s %14s %6s %16s %14s\n", "region", "calls", "cycles/call",
+		"IPC", "cache miss/kinst", "branch miss %");
+	for (r = 0; r < PF_REGIONS; ++ r)
+	{
+		uint64_t *t = pf_totals[r];
+		if (!pf_calls[r])
+			continue;
+		fprintf (stderr, "%-12s %10llu %14.0f %6.2f %16.3f %14.2f\n", pf_names[r],
+			(unsigned long long) pf_calls[r], (double) t[0] / pf_calls[r],
+			t[0] ? (double) t[1] / t[0] : 0, t[1] ? 1000.0 * t[2] / t[1] : 0,
+			t[3] ? 100.0 * t[4] / t[3] : 0);
+	}
+}
+
+/* start counting, if this machine lets us; returns whether it does */
+int pf_init ()
+{
+	struct PfSample s;
+	if (pf_on) // -P given twice
+		return 1;
+	if (!pf_read (&s))
+	{
+		fprintf (stderr, "Performance counters unavailable: %s\n", strerror (errno));
+		return 0;
+	}
+	pf_lock = SDL_CreateMutex ();
+	pf_on = 1;
+	atexit (pf_report);
+	return 1;
+}
+
+#endif
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
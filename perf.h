@@ -0,0 +1,46 @@
+#ifndef PERF_H_INCLUDED
+#define PERF_H_INCLUDED
+
+#include <stdint.h>
+
+/* Prefix pf_ is for hardware performance counters (Linux perf_event_open).
+ * Whatever runs between pf_begin and pf_end is charged to a named region:
+ * cycles, instructions, cache misses, branches and branch misses, counted
+ * for the calling thread only (each thread opens its own counters the first
+ * time it needs them). Until pf_init turns counting on, pf_begin and pf_end
+ * do nothing; afterwards IPC and miss rates for each region are reported at
+ * exit. Regions can nest, but the inner one's reads are charged to the
+ * outer one. Each pf_begin and pf_end reads the whole group in one system
+ * call, which costs about as much as a player's input or collisions do, so
+ * regions are no finer than a step or a draw band. Build with
+ * -DNO_PERF_COUNTERS to leave it all out. */
+
+enum
+{
+	PF_FRAME,      // one whole frame of the game or of a headless run
+	PF_STEP,       // ls_step
+	PF_DRAW,       // draw_band's fills
+	PF_REGIONS
+};
+
+#define PF_EVENTS 5
+
+// counter values at pf_begin
+struct PfSample
+{
+	uint64_t v[PF_EVENTS];
+};
+
+int  pf_init  ();
+
+#ifdef NO_PERF_COUNTERS
+#  define pf_begin(s) ((void) (s))
+#  define pf_end(r,s) ((void) (s))
+#else
+void pf_begin (struct PfSample *);
+void pf_end   (int, struct PfSample *);
+#endif
+
+#endif /* PERF_H_INCLUDED */
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
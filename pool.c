@@ -0,0 +1,116 @@
+#include "pool.h"
+#include "mem.h"
+#include "SDL.h"
+
+struct ThreadPool
+{
+	int nthreads; // workers, not counting whoever calls tp_run
+	SDL_Thread **threads;
+	SDL_mutex *lock;
+	SDL_cond *go, *done;
+	int generation; // bumped for each new job
+	int busy; // workers yet to finish the current job
+	int quit;
+	// the current job:
+	void (*fn) (void *, int);
+	void *arg;
+	int n;
+	SDL_atomic_t next; // next index to hand out
+};
+
+static void tp_work (struct ThreadPool *tp)
+{
+	int i;
+	while ((i = SDL_AtomicAdd (&tp->next, 1)) < tp->n)
+		tp->fn (tp->arg, i);
+}
+
+static int tp_worker (void *data)
+{
+	struct ThreadPool *tp = data;
+	int seen = 0;
+	SDL_LockMutex (tp->lock);
+	while (1)
+	{
+		while (tp->generation == seen && !tp->quit)
+			SDL_CondWait (tp->go, tp->lock);
+		if (tp->quit)
+			break;
+		seen = tp->generation;
+		SDL_UnlockMutex (tp->lock);
+		tp_work (tp);
+		SDL_LockMutex (tp->lock);
+		if (-- tp->busy == 0)
+			SDL_CondSignal (tp->done);
+	}
+	SDL_UnlockMutex (tp->lock);
+	return 0;
+}
+
+/* make a pool that runs jobs on nthreads threads in total;
+ * nthreads <= 0 means one per CPU */
+struct ThreadPool *tp_init (int nthreads)
+{
+	if (nthreads <= 0)
+		nthreads = SDL_GetCPUCount ();
+	struct ThreadPool *tp = mm_alloc (MM_OTHER, sizeof(struct ThreadPool));
+	*tp = (struct ThreadPool) {nthreads - 1, mm_alloc (MM_OTHER, sizeof(SDL_Thread *) * nthreads),
+		SDL_CreateMutex (), SDL_CreateCond (), SDL_CreateCond (), };
+	int i;
+	for (i = 0; i < tp->nthreads; ++ i)
+		tp->threads[i] = SDL_CreateThread (tp_worker, "tp_worker", tp);
+	return tp;
+}
+
+void tp_run (struct ThreadPool *tp, int n, void (*fn) (void *, int), void *arg)
+{
+	int i;
+	if (!tp || !tp->nthreads || n <= 1)
+	{
+		for (i = 0; i < n; ++ i)
+			fn (arg, i);
+		return;
+	}
+	SDL_LockMutex (tp->lock);
+	tp->fn = fn;
+	tp->arg = arg;
+	tp->n = n;
+	SDL_AtomicSet (&tp->next, 0);
+	tp->busy = tp->nthreads;
+	++ tp->generation;
+	SDL_CondBroadcast (tp->go);
+	SDL_UnlockMutex (tp->lock);
+
+	tp_work (tp);
+
+	SDL_LockMutex (tp->lock);
+	while (tp->busy)
+		SDL_CondWait (tp->done, tp->lock);
+	SDL_UnlockMutex (tp->lock);
+}
+
+// number of threads tp_run spreads work over
+int tp_size (struct ThreadPool *tp)
+{
+	return tp ? tp->nthreads + 1 : 1;
+}
+
+void tp_free (struct ThreadPool *tp)
+{
+	if (!tp)
+		return;
+	SDL_LockMutex (tp->lock);
+	tp->quit = 1;
+	SDL_CondBroadcast (tp->go);
+	SDL_UnlockMutex (tp->lock);
+	int i;
+	for (i = 0; i < tp->nthreads; ++ i)
+		SDL_WaitThread (tp->threads[i], NULL);
+	mm_free (tp->threads);
+	SDL_DestroyCond (tp->go);
+	SDL_DestroyCond (tp->done);
+	SDL_DestroyMutex (tp->lock);
+	mm_free (tp);
+}
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
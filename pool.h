@@ -0,0 +1,18 @@
+#ifndef POOL_H_INCLUDED
+#define POOL_H_INCLUDED
+
+/* Prefix tp_ is for the thread pool.
+ * tp_run calls fn(arg, i) for every i in [0, n) spread over the pool's
+ * threads (the caller joins in) and returns once all calls are done, so
+ * it doubles as a barrier. A NULL pool runs everything on the caller. */
+
+struct ThreadPool;
+
+struct ThreadPool *tp_init (int);
+void tp_run  (struct ThreadPool *, int, void (*) (void *, int), void *);
+int  tp_size (struct ThreadPool *);
+void tp_free (struct ThreadPool *);
+
+#endif /* POOL_H_INCLUDED */
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
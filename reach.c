@@ -0,0 +1,396 @@
+#include "reach.h"
+
+#include "hash.h"
+#include "mem.h"
+#include "tile.h"
+#include <math.h>
+#include <string.h>
+
+// one lever configuration
+struct RgConfig
+{
+	char *level; // its tiles
+	uint64_t hash; // hc_level of them
+	int pull[RG_LEVERS]; // what pulling each lever turns it into, or -1 if not worked out yet
+	int *region; // which region each tile is in, or -1 if a player can't be there
+	int num_regions;
+	uint32_t *leads; // a row of words bits for each region: the regions it leads to (itself included)
+	char *possible; // whether a player can ever be at each tile in this configuration
+};
+
+struct Reach
+{
+	int levelw, levelh, size; // level dimensions, and tiles
+	int words; // uint32_ts in a row of leads
+	int climb, across; // how many tiles up and across a jump can take a player
+	char *ctrl, *action, *cantravel; // as in the Setup
+	struct LevelState *scratch; // where levers are pulled to make new configurations
+	Vector configs; // struct RgConfig, the first being the level as it starts
+	int levers; // bit i is set if lever '1'+i can be pulled
+	int goal; // a player can get to the goal
+	int complete; // every configuration was worked out
+};
+
+#define OPEN(c) (!(TILE(c)->flags & (TT_SOLID | TT_HAZARD))) // somewhere a player can be
+#define SOLID(c) (TILE(c)->flags & TT_SOLID)
+
+// every tile from (x0, y0) to (x1, y1), along a row or down a column, is open
+static int rg_clear (const struct Reach *rg, const char *level, int x0, int y0, int x1, int y1)
+{
+	int dx = (x1 > x0) - (x1 < x0), dy = (y1 > y0) - (y1 < y0);
+	for (; x0 != x1 || y0 != y1; x0 += dx, y0 += dy)
+		if (!OPEN(level[x0 + rg->levelw*y0]))
+			return 0;
+	return OPEN(level[x1 + rg->levelw*y1]);
+}
+
+/* the tiles a player at tile b can get to in a moment: along or off a ledge,
+ * anywhere a jump could reach (up then across, or across then up), or down
+ * while falling; returns how many */
+static int rg_moves (const struct Reach *rg, const char *level, int b, int *to)
+{
+	int levelw = rg->levelw, x = b % levelw, y = b / levelw;
+	int n = 0, tx, ty;
+	if (b + levelw >= rg->size || SOLID(level[b + levelw]) ||
+		(x + 1 < levelw && b + levelw + 1 < rg->size && SOLID(level[b + levelw + 1]))) // standing (perhaps on the next tile along)
+	{
+		for (ty = y - rg->climb; ty <= y; ++ ty)
+			for (tx = x - rg->across; tx <= x + rg->across; ++ tx)
+				if (ty >= 0 && tx >= 0 && tx < levelw && (tx != x || ty != y) &&
+					((rg_clear (rg, level, x, y, x, ty) && rg_clear (rg, level, x, ty, tx, ty)) ||
+					(rg_clear (rg, level, x, y, tx, y) && rg_clear (rg, level, tx, y, tx, ty))))
+					to[n++] = tx + levelw*ty;
+	}
+	else // falling, drifting one way or the other
+		for (tx = x - 1; tx <= x + 1; ++ tx)
+			if (tx >= 0 && tx < levelw && b + levelw < rg->size && OPEN(level[tx + levelw*(y+1)]) &&
+				(OPEN(level[tx + levelw*y]) || OPEN(level[b + levelw])))
+				to[n++] = tx + levelw*(y+1);
+	return n;
+}
+
+// Tarjan's strongly connected components, each of which is a region
+struct RgSearch
+{
+	const struct Reach *rg;
+	struct RgConfig *cf;
+	int *index, *low, *stack;
+	int *to, *num_to, most; // each tile's moves, most to a row
+	int next, len;
+	char *on_stack;
+};
+
+static void rg_visit (struct RgSearch *s, int b)
+{
+	const struct Reach *rg = s->rg;
+	int *to = s->to + b*s->most, n = s->num_to[b] = rg_moves (rg, s->cf->level, b, to), i;
+	s->index[b] = s->low[b] = s->next ++;
+	s->stack[s->len ++] = b;
+	s->on_stack[b] = 1;
+	for (i = 0; i < n; ++ i)
+	{
+		if (s->index[to[i]] < 0)
+		{
+			rg_visit (s, to[i]);
+			if (s->low[to[i]] < s->low[b])
+				s->low[b] = s->low[to[i]];
+		}
+		else if (s->on_stack[to[i]] && s->index[to[i]] < s->low[b])
+			s->low[b] = s->index[to[i]];
+	}
+	if (s->low[b] != s->index[b])
+		return;
+	// b is the first of a new region; everything it leads to is done already
+	int r = s->cf->num_regions ++, t;
+	do
+	{
+		t = s->stack[-- s->len];
+		s->on_stack[t] = 0;
+		s->cf->region[t] = r;
+	}
+	while (t != b);
+}
+
+// split a configuration's tiles into regions, and find which lead to which
+static void rg_regions (struct Reach *rg, struct RgConfig *cf)
+{
+	int size = rg->size, most = (rg->climb + 1)*(2*rg->across + 1) + 3, b, i, w;
+	struct RgSearch s = {rg, cf, mm_alloc (MM_OTHER, sizeof(int) * size), mm_alloc (MM_OTHER, sizeof(int) * size),
+		mm_alloc (MM_OTHER, sizeof(int) * size), mm_alloc (MM_OTHER, sizeof(int) * size * most),
+		mm_alloc (MM_OTHER, sizeof(int) * size), most, 0, 0, mm_alloc (MM_OTHER, size)};
+	memset (s.on_stack, 0, size);
+	for (b = 0; b < size; ++ b)
+		s.index[b] = cf->region[b] = -1;
+	for (b = 0; b < size; ++ b)
+		if (s.index[b] < 0 && OPEN(cf->level[b]))
+			rg_visit (&s, b);
+
+	/* regions are numbered so that each one only leads to lower ones, so
+	 * going up from 0 everything a region leads to is known before it */
+	cf->leads = mm_alloc (MM_LEVEL, sizeof(uint32_t) * rg->words * (cf->num_regions ? cf->num_regions : 1));
+	memset (cf->leads, 0, sizeof(uint32_t) * rg->words * cf->num_regions);
+	int r;
+	for (r = 0; r < cf->num_regions; ++ r)
+	{
+		uint32_t *row = cf->leads + r*rg->words;
+		row[r/32] |= 1u << r%32;
+		for (b = 0; b < size; ++ b)
+		{
+			if (cf->region[b] != r)
+				continue;
+			for (i = 0; i < s.num_to[b]; ++ i)
+			{
+				int t = cf->region[s.to[b*most + i]];
+				if (t == r)
+					continue;
+				uint32_t *from = cf->leads + t*rg->words;
+				for (w = 0; w < rg->words; ++ w)
+					row[w] |= from[w];
+			}
+		}
+	}
+	mm_free (s.index);
+	mm_free (s.low);
+	mm_free (s.stack);
+	mm_free (s.to);
+	mm_free (s.num_to);
+	mm_free (s.on_stack);
+}
+
+// the configuration with these tiles, adding it if it's new; -1 if there's no room
+static int rg_find (struct Reach *rg, const char *level)
+{
+	uint64_t hash = hc_level (level);
+	int c;
+	for (c = 0; c < rg->configs->len; ++ c)
+	{
+		struct RgConfig *cf = v_at (rg->configs, c);
+		if (cf->hash == hash && !memcmp (cf->level, level, rg->size))
+			return c;
+	}
+	if (c == RG_CONFIGS)
+	{
+		rg->complete = 0;
+		return -1;
+	}
+	struct RgConfig cf = {mm_alloc (MM_LEVEL, rg->size + 1), hash, {0,}, mm_alloc (MM_LEVEL, sizeof(int) * rg->size),
+		0, NULL, mm_alloc (MM_LEVEL, rg->size)};
+	memcpy (cf.level, level, rg->size + 1);
+	memset (cf.pull, -1, sizeof(cf.pull));
+	memset (cf.possible, 0, rg->size);
+	rg_regions (rg, &cf);
+	v_push (rg->configs, &cf);
+	return c;
+}
+
+// the configuration pulling lever id in configuration c makes, or -1 if it's one too many
+static int rg_pull (struct Reach *rg, int c, char id)
+{
+	struct RgConfig *cf = v_at (rg->configs, c);
+	int i = id - '1';
+	if (cf->pull[i] >= 0)
+		return cf->pull[i];
+	struct LevelState *ls = rg->scratch;
+	memcpy (ls->level, cf->level, rg->size);
+	ls->undo->len = 0;
+	ls_use_ctrl (ls, id);
+	int to = rg_find (rg, ls->level);
+	((struct RgConfig *) v_at (rg->configs, c))->pull[i] = to; // rg_find may have moved it
+	return to;
+}
+
+// note that a player can be at tile b in configuration c
+static void rg_mark (struct Reach *rg, Vector todo, int c, int b)
+{
+	struct RgConfig *cf = v_at (rg->configs, c);
+	if (cf->region[b] < 0 || cf->possible[b])
+		return;
+	cf->possible[b] = 1;
+	int next = c*rg->size + b;
+	v_push (todo, &next);
+}
+
+// a player at tile b in configuration c pulls lever id
+static void rg_pulled (struct Reach *rg, Vector todo, int c, int b, char id)
+{
+	if (id < '1' || id - '1' >= RG_LEVERS || id - '1' >= strlen (rg->action))
+		return; // does nothing
+	rg->levers |= 1 << (id - '1');
+	int to = rg_pull (rg, c, id), levelw = rg->levelw;
+	if (to < 0)
+		return;
+	// still here, or pushed out of whatever the lever put here
+	rg_mark (rg, todo, to, b);
+	if (((struct RgConfig *) v_at (rg->configs, to))->region[b] >= 0)
+		return;
+	if (b % levelw > 0)
+		rg_mark (rg, todo, to, b - 1);
+	if (b % levelw < levelw - 1)
+		rg_mark (rg, todo, to, b + 1);
+	if (b >= levelw)
+		rg_mark (rg, todo, to, b - levelw);
+	if (b + levelw < rg->size)
+		rg_mark (rg, todo, to, b + levelw);
+}
+
+// everywhere a player at tile b in configuration c can get to, and what they can do there
+static void rg_explore (struct Reach *rg, Vector todo, int c, int b, int *travelled)
+{
+	struct RgConfig *cf = v_at (rg->configs, c);
+	uint32_t *leads = cf->leads + cf->region[b]*rg->words;
+	int t;
+	for (t = 0; t < rg->size; ++ t)
+		if (cf->region[t] >= 0 && leads[cf->region[t]/32] >> cf->region[t]%32 & 1)
+			rg_mark (rg, todo, c, t);
+	int flags = TILE(cf->level[b])->flags;
+	if (flags & TT_GOAL)
+		rg->goal = 1;
+	char id = rg->ctrl[b];
+	if (flags & TT_LEVER)
+		rg_pulled (rg, todo, c, b, id);
+	for (id = '1'; id < '1' + REMOTE_LEVERS; ++ id)
+		rg_pulled (rg, todo, c, b, id); // remotely, from wherever they are
+	if (!rg->cantravel || rg->cantravel[b % rg->levelw] != '0')
+	{
+		// back to the start of the level, with a ghost to pull levers again
+		*travelled = 1;
+		rg_mark (rg, todo, 0, b);
+	}
+}
+
+/* work out a level's region graph; cheap enough to do as a level starts */
+struct Reach *rg_build (const struct Setup *s)
+{
+	struct Reach *rg = mm_alloc (MM_OTHER, sizeof(struct Reach));
+	int size = strlen (s->initlevel), levelw = s->levelw;
+	float rise = jumpvel*jumpvel / (2*const_grav), airtime = -2*jumpvel / const_grav;
+	*rg = (struct Reach) {levelw, (size-1)/levelw + 1, size, (size + 31)/32, rise / blockwidth,
+		ceilf (airtime*movevel / blockwidth), NULL, NULL, NULL, ls_init (NULL, s),
+		v_dinit (sizeof(struct RgConfig), MM_OTHER), 0, 0, 1};
+	rg->ctrl = rg->scratch->ctrl;
+	rg->action = rg->scratch->action;
+	rg->cantravel = rg->scratch->cantravel;
+	rg_find (rg, s->initlevel);
+
+	Vector todo = v_dinit (sizeof(int), MM_OTHER);
+	int start = block (s->i_plx, s->i_ply, levelw), travelled = 0, c, b, more = 1;
+	if (start >= 0 && start < size)
+		rg_mark (rg, todo, 0, start);
+	while (more)
+	{
+		while (todo->len)
+		{
+			int next = *(int *) v_at (todo, -- todo->len);
+			rg_explore (rg, todo, next / size, next % size, &travelled);
+		}
+		if (!travelled)
+			break;
+		/* Once anyone has travelled back, ghosts can pull any lever anyone
+		 * has pulled, whenever they like: anywhere a player can be, they
+		 * can be in any configuration */
+		more = 0;
+		for (c = 0; c < rg->configs->len; ++ c)
+		{
+			struct RgConfig *cf = v_at (rg->configs, c);
+			for (b = 0; b < size; ++ b)
+			{
+				if (!cf->possible[b])
+					continue;
+				int d;
+				for (d = 0; d < rg->configs->len; ++ d)
+				{
+					struct RgConfig *other = v_at (rg->configs, d);
+					if (other->region[b] >= 0 && !other->possible[b])
+					{
+						rg_mark (rg, todo, d, b);
+						more = 1;
+					}
+				}
+			}
+		}
+	}
+	v_free (todo);
+	return rg;
+}
+
+void rg_free (struct Reach *rg)
+{
+	int c;
+	for (c = 0; c < rg->configs->len; ++ c)
+	{
+		struct RgConfig *cf = v_at (rg->configs, c);
+		mm_free (cf->level);
+		mm_free (cf->region);
+		mm_free (cf->leads);
+		mm_free (cf->possible);
+	}
+	v_free (rg->configs);
+	ls_free (rg->scratch);
+	mm_free (rg);
+}
+
+/* which configuration a level's tiles are in, or -1 if it's one the graph
+ * never got to (which can only be because there were too many) */
+int rg_config (const struct Reach *rg, const char *level)
+{
+	uint64_t hash = hc_level (level);
+	int c;
+	for (c = 0; c < rg->configs->len; ++ c)
+	{
+		struct RgConfig *cf = v_at (rg->configs, c);
+		if (cf->hash == hash && !memcmp (cf->level, level, rg->size))
+			return c;
+	}
+	return -1;
+}
+
+// the region tile b is in, in configuration c; -1 if a player can't be there
+int rg_region (const struct Reach *rg, int c, int b)
+{
+	return ((struct RgConfig *) v_at (rg->configs, c))->region[b];
+}
+
+/* whether a player at tile from can get to tile to without the tiles
+ * changing; if the configuration isn't known, they might */
+int rg_reaches (const struct Reach *rg, int c, int from, int to)
+{
+	if (c < 0)
+		return 1;
+	struct RgConfig *cf = v_at (rg->configs, c);
+	int r = cf->region[from], t = cf->region[to];
+	return r >= 0 && t >= 0 && (cf->leads[r*rg->words + t/32] >> t%32 & 1);
+}
+
+/* whether a player could ever be at tile b while the level is in
+ * configuration c; if that isn't known, they might */
+int rg_possible (const struct Reach *rg, int c, int b)
+{
+	if (c < 0)
+		return !rg->complete;
+	return ((struct RgConfig *) v_at (rg->configs, c))->possible[b];
+}
+
+// bit i is set if lever '1'+i can ever be pulled
+int rg_levers (const struct Reach *rg)
+{
+	return rg->levers;
+}
+
+// whether anyone can ever get to the goal
+int rg_goal (const struct Reach *rg)
+{
+	return rg->goal || !rg->complete;
+}
+
+int rg_configs (const struct Reach *rg)
+{
+	return rg->configs->len;
+}
+
+// whether every configuration the levers can make was worked out
+int rg_complete (const struct Reach *rg)
+{
+	return rg->complete;
+}
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
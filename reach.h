@@ -0,0 +1,46 @@
+#ifndef REACH_H_INCLUDED
+#define REACH_H_INCLUDED
+
+#include "level.h"
+#include <stdint.h>
+
+/* Prefix rg_ is for a level's region graph.
+ * rg_build works out, from the tiles alone and the movement constants,
+ * where a player could possibly get to in a level without simulating a
+ * frame. For every lever configuration (every different set of tiles the
+ * levers can make) it splits the open tiles into regions, each a set of
+ * tiles a player can get back and forth between, and notes which regions
+ * lead to which. It then follows players through the configurations -
+ * pulling levers, travelling back in time and leaving ghosts to pull them
+ * later, or pressing them remotely from anywhere - to find every
+ * (configuration, tile) a player could ever be in, and so which levers can
+ * be pulled and whether the goal can be reached.
+ *
+ * Moves are worked out generously from the tiles alone: a jump can take a
+ * player to any tile within its height and reach that an open path leads
+ * to (up then across, or across then up), and a fall to the tile below or
+ * either side of it. Momentum carried from one move into the next isn't
+ * followed, so a player going fast can now and then get somewhere the
+ * graph rules out; what it rules out is unlikely rather than impossible,
+ * and not everything it allows is possible either. It is for throwing
+ * away hopeless states, not for proving a level solvable or unsolvable. */
+
+#define RG_CONFIGS 256 // configurations worked out before giving up on the rest
+#define RG_LEVERS  9   // lever ids '1' to '9'
+
+struct Reach;
+
+struct Reach *rg_build (const struct Setup *);
+void rg_free     (struct Reach *);
+int  rg_config   (const struct Reach *, const char *);
+int  rg_region   (const struct Reach *, int, int);
+int  rg_reaches  (const struct Reach *, int, int, int);
+int  rg_possible (const struct Reach *, int, int);
+int  rg_levers   (const struct Reach *);
+int  rg_goal     (const struct Reach *);
+int  rg_configs  (const struct Reach *);
+int  rg_complete (const struct Reach *);
+
+#endif /* REACH_H_INCLUDED */
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
@@ -0,0 +1,246 @@
+#include "replay.h"
+#include "graphics.h"
+#include "mem.h"
+
+#include <stdio.h>
+
+static void rp_snapshot (struct Replay *rp)
+{
+	struct LevelState *ls = rp->ls;
+	Vector pss = ls->player_states;
+	struct Snapshot snap = {ls->undo->len, mm_alloc (MM_HISTORY, sizeof(struct Body) * pss->len),
+		mm_alloc (MM_HISTORY, pss->len)};
+	int i;
+	for (i = 0; i < pss->len; ++ i)
+	{
+		struct PlayerState *ps = v_at (pss, i);
+		snap.bodies[i] = bd_get (&ls->bodies, ps->id);
+		snap.extant[i] = ps->extant;
+	}
+	v_push (rp->snaps, &snap);
+}
+
+// point player i's recording at the struct Keys it is playing at frame
+static void rp_cursor (struct Replay *rp, int i, int frame)
+{
+	struct PlayerState *ps = v_at (rp->ls->player_states, i);
+	int *ends = rp->ends[i];
+	int f = frame - ps->rec.start;
+	// first struct Keys that hasn't finished by f
+	int lo = 0, hi = ps->rec.len;
+	while (lo < hi)
+	{
+		int mid = (lo + hi)/2;
+		if (ends[mid] > f)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	ps->rec.curinput = lo;
+	ps->rec.curframe = f - (lo ? ends[lo-1] : 0);
+}
+
+static void rp_restore (struct Replay *rp, int s)
+{
+	struct LevelState *ls = rp->ls;
+	struct Snapshot *snap = v_at (rp->snaps, s);
+	// tiles: undo back to the snapshot, or redo forward to it from the tape
+	ls_rollback (ls, snap->mark);
+	while (ls->undo->len < snap->mark)
+	{
+		struct TileChange *tc = v_at (rp->tape, ls->undo->len);
+		ls_set_tile (ls, tc->b, tc->to);
+	}
+	ls->frame = s * RP_INTERVAL;
+	/* the chain back to this frame too: rp_init ran the whole level, and
+	 * stepping again only writes the same hashes over it, so the ones after
+	 * are still there when going forwards */
+	if (ls->hashes)
+		ls->hashes->len = ls->frame;
+	int i;
+	for (i = 0; i < ls->player_states->len; ++ i)
+	{
+		struct PlayerState *ps = v_at (ls->player_states, i);
+		bd_set (&ls->bodies, ps->id, &snap->bodies[i]);
+		ps->extant = snap->extant[i];
+		if (ps->extant)
+			rp_cursor (rp, i, ls->frame);
+	}
+}
+
+/* index a level with every player recorded; simulates the whole thing once
+ * and leaves the level at frame 0 */
+struct Replay *rp_init (struct LevelState *ls)
+{
+	struct Replay *rp = mm_alloc (MM_HISTORY, sizeof(struct Replay));
+	Vector pss = ls->player_states;
+	*rp = (struct Replay) {ls, mm_alloc (MM_HISTORY, sizeof(int *) * pss->len),
+		v_dinit (sizeof(struct Snapshot), MM_HISTORY), NULL, 0, 1};
+	int i, j;
+	for (i = 0; i < pss->len; ++ i)
+	{
+		struct PlayerRecording *rec = &((struct PlayerState *) v_at (pss, i))->rec;
+		int sum = 0;
+		rp->ends[i] = mm_alloc (MM_HISTORY, sizeof(int) * rec->len);
+		for (j = 0; j < rec->len; ++ j)
+		{
+			sum += kr_at (rec->runs, rec->first + j)->frames;
+			rp->ends[i][j] = sum;
+		}
+	}
+
+	ls_reset (ls);
+	int state = 0;
+	while (!state)
+	{
+		if (ls->frame % RP_INTERVAL == 0)
+			rp_snapshot (rp);
+		state = ls_step (ls);
+	}
+	// ls_step only notices everyone has gone on the frame after
+	rp->length = ls->frame - (state == 1);
+	// keep every tile change of the run so snapshots can be redone
+	rp->tape = v_init (sizeof(struct TileChange), ls->undo->len + 1, MM_HISTORY);
+	for (i = 0; i < ls->undo->len; ++ i)
+		v_push (rp->tape, v_at (ls->undo, i));
+	rp_restore (rp, 0);
+	return rp;
+}
+
+void rp_free (struct Replay *rp)
+{
+	int i;
+	for (i = 0; i < rp->snaps->len; ++ i)
+	{
+		struct Snapshot *snap = v_at (rp->snaps, i);
+		mm_free (snap->bodies);
+		mm_free (snap->extant);
+	}
+	v_free (rp->snaps);
+	v_free (rp->tape);
+	for (i = 0; i < rp->ls->player_states->len; ++ i)
+		mm_free (rp->ends[i]);
+	mm_free (rp->ends);
+	mm_free (rp);
+}
+
+// move the level to any frame, forwards or backwards
+void rp_seek (struct Replay *rp, int frame)
+{
+	struct LevelState *ls = rp->ls;
+	if (frame < 0)
+		frame = 0;
+	else if (frame > rp->length)
+		frame = rp->length;
+	int s = frame / RP_INTERVAL;
+	if (s >= rp->snaps->len)
+		s = rp->snaps->len - 1;
+	// carry on from where we are if that's no further than from the snapshot
+	if (ls->frame > frame || ls->frame < s * RP_INTERVAL)
+		rp_restore (rp, s);
+	while (ls->frame < frame)
+		ls_step (ls);
+}
+
+/* write every player's recording, one "player" line giving where it starts
+ * followed by a line per struct Keys ("-" if no keys were held) */
+void rp_write (FILE *f, struct LevelState *ls)
+{
+	int i, j;
+	for (i = 0; i < ls->player_states->len; ++ i)
+	{
+		struct PlayerRecording *rec = &((struct PlayerState *) v_at (ls->player_states, i))->rec;
+		fprintf (f, "player %a %a %a %a %d %d\n", rec->i_plx, rec->i_ply,
+			rec->i_plxv, rec->i_plyv, rec->start, rec->len);
+		for (j = 0; j < rec->len; ++ j)
+		{
+			struct Keys *k = kr_at (rec->runs, rec->first + j);
+			char held[MAX_SIMULTANEOUS_KEYS + 1] = {0,};
+			memcpy (held, k->held, MAX_SIMULTANEOUS_KEYS);
+			fprintf (f, "%d %s\n", k->frames, held[0] ? held : "-");
+		}
+	}
+}
+
+#define RP_STR_(x) #x
+#define RP_STR(x) RP_STR_(x)
+/* add players to a level from recordings written by rp_write, and reset it
+ * ready to play them back; stops at the first line that isn't part of a
+ * recording, and returns 0 if the recordings are malformed */
+int rp_read (FILE *f, struct LevelState *ls)
+{
+	struct Body b = {0,};
+	int start, len;
+	while (fscanf (f, " player %a %a %a %a %d %d", &b.x, &b.y, &b.xv, &b.yv, &start, &len) == 6)
+	{
+		new_player (ls, &b, start);
+		struct PlayerRecording *rec = &((struct PlayerState *) v_at (ls->player_states, ls->player_states->len - 1))->rec;
+		while (len --)
+		{
+			struct Keys k = {{0,}, 0};
+			char held[MAX_SIMULTANEOUS_KEYS + 1];
+			if (fscanf (f, " %d %" RP_STR(MAX_SIMULTANEOUS_KEYS) "s", &k.frames, held) != 2 || k.frames <= 0)
+				return 0;
+			if (strcmp (held, "-"))
+				memcpy (k.held, held, strlen (held));
+			kr_push (rec->runs, &k);
+			++ rec->len;
+		}
+	}
+	if (!ls->player_states->len)
+		return 0;
+	ls_reset (ls);
+	return 1;
+}
+
+/* one frame of the viewer: returns -1 to carry on viewing, or else as rp_view */
+int rp_view_frame (struct Replay *rp)
+{
+	struct LevelState *ls = rp->ls;
+	if (gr_is_pressed_debounce (ls->en->gr, GRK_ESC))
+		return 0;
+	if (gr_is_pressed_debounce (ls->en->gr, GRK_RET))
+		return 1;
+
+	int frame = ls->frame;
+	if (gr_is_pressed_debounce (ls->en->gr, ' '))
+		rp->playing = !rp->playing;
+	if (gr_is_pressed (ls->en->gr, GRK_RT) || gr_is_pressed (ls->en->gr, GRK_LT))
+	{
+		rp->playing = 0;
+		frame += gr_is_pressed (ls->en->gr, GRK_RT) - gr_is_pressed (ls->en->gr, GRK_LT);
+	}
+	else if (rp->playing && frame < rp->length)
+		++ frame;
+	if (gr_is_pressed_debounce (ls->en->gr, GRK_UP))
+		frame += RP_JUMP;
+	if (gr_is_pressed_debounce (ls->en->gr, GRK_DN))
+		frame -= RP_JUMP;
+	if (gr_is_pressed_debounce (ls->en->gr, '['))
+		frame = 0;
+	if (gr_is_pressed_debounce (ls->en->gr, ']'))
+		frame = rp->length;
+	rp_seek (rp, frame);
+
+	ls_follow (ls, v_at (ls->player_states, ls->player_states->len-1));
+	draw_level (ls);
+	return -1;
+}
+
+/* let the player scrub through a finished level:
+ * space plays/pauses, left/right step a frame, up/down jump RP_JUMP frames,
+ * [ and ] go to the start and end; enter carries on and escape quits.
+ * return values:
+ * 0: quit entirely;
+ * 1: carry on */
+int rp_view (struct LevelState *ls)
+{
+	struct Replay *rp = rp_init (ls);
+	int ret;
+	while ((ret = rp_view_frame (rp)) < 0)
+		;
+	rp_free (rp);
+	return ret;
+}
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
@@ -0,0 +1,45 @@
+#ifndef REPLAY_H_INCLUDED
+#define REPLAY_H_INCLUDED
+
+#include "level.h"
+#include <stdio.h>
+
+/* Prefix rp_ is for the replay viewer.
+ * A Replay indexes a level whose players are all recordings, so that any
+ * frame can be reached by restoring the nearest earlier snapshot and then
+ * simulating fewer than RP_INTERVAL frames. Where each recording is up to
+ * at a given frame is found by binary search over prefix sums of its
+ * struct Keys frame counts, and tiles are put back by undoing or redoing
+ * the level's undo log, so snapshots only need to hold bodies. */
+
+#define RP_INTERVAL 64 // frames between snapshots
+#define RP_JUMP     60 // frames skipped by up/down in the viewer
+
+struct Snapshot
+{
+	int mark; // length of the undo log at this frame
+	struct Body *bodies; // one per player
+	char *extant; // one per player
+};
+
+struct Replay
+{
+	struct LevelState *ls; // level being replayed (not owned)
+	int **ends; // per player: frame at which each struct Keys finishes
+	Vector snaps; // struct Snapshot for every RP_INTERVAL'th frame
+	Vector tape; // struct TileChange for the whole run, for redoing
+	int length; // last frame with a player still extant
+	int playing; // the viewer is playing rather than paused
+};
+
+struct Replay *rp_init (struct LevelState *);
+void rp_free  (struct Replay *);
+void rp_seek  (struct Replay *, int);
+int  rp_view  (struct LevelState *);
+int  rp_view_frame (struct Replay *);
+void rp_write (FILE *, struct LevelState *);
+int  rp_read  (FILE *, struct LevelState *);
+
+#endif /* REPLAY_H_INCLUDED */
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
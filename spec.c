@@ -0,0 +1,243 @@
+#include "spec.h"
+
+#include "mem.h"
+#include "SDL.h"
+#include <string.h>
+
+// the recorded players' part of one frame, worked out ahead of time
+struct SpecFrame
+{
+	int frame; // ls->frame once it has been run
+	char *level; // the level it assumed at its start
+	Vector changes; // struct TileChange for each tile the players changed
+	struct PlayerState *ps; // the players afterwards
+	struct Body *bodies;
+	int num_ext, state; // as from ls_step_range
+	int paradox; // and whether a -1 was a paradox
+};
+
+struct Speculator
+{
+	int n; // players [0, n) are moved ahead
+	int size; // bytes in the level
+	struct LevelState *g; // the worker's copy of the level
+	struct LevelState *seed; // a copy to start again from, if not NULL
+	int gen; // bumped by every reseed, so stale frames can be dropped
+	struct SpecFrame ring[SP_AHEAD]; // frames ready to be taken
+	int head, len; // oldest frame in ring, and how many there are
+	int done; // the last frame ended the run, so there's no point going on
+	int stopping;
+	SDL_mutex *lock;
+	SDL_cond *wake, *ready;
+	SDL_Thread *worker;
+};
+
+/* a copy of a level's tiles and players, sharing everything they only read;
+ * the key runs are shared as a fork's are, so the live player adding to
+ * them never changes a chunk the worker is reading */
+static struct LevelState *sp_fork (struct LevelState *ls)
+{
+	struct LevelState *g = mm_alloc (MM_LEVEL, sizeof(struct LevelState));
+	*g = *ls;
+	g->level = mm_alloc (MM_LEVEL, strlen (ls->level) + 1);
+	strcpy (g->level, ls->level);
+	g->tiles_shared = NULL; // its tiles are its own; the rest is ls's
+	g->player_states = v_dinit (sizeof(struct PlayerState), MM_PLAYERS);
+	g->bodies = (struct Bodies) {0,};
+	g->undo = v_dinit (sizeof(struct TileChange), MM_HISTORY);
+	g->update = LS_SERIAL;
+	g->pool = NULL;
+	g->hashes = NULL;
+	g->spec = NULL;
+	kr_fork (&g->runs, &ls->runs);
+	int i;
+	for (i = 0; i < ls->player_states->len; ++ i)
+	{
+		struct PlayerState *ps = v_push (g->player_states, v_at (ls->player_states, i));
+		ps->rec.runs = &g->runs;
+	}
+	for (i = 0; i < ls->bodies.len; ++ i)
+	{
+		struct Body b = bd_get (&ls->bodies, i);
+		bd_add (&g->bodies, &b);
+	}
+	return g;
+}
+
+static void sp_free_fork (struct LevelState *g)
+{
+	mm_free (g->level);
+	v_free (g->player_states);
+	bd_free (&g->bodies);
+	kr_free (&g->runs);
+	v_free (g->undo);
+	mm_free (g);
+}
+
+// move the worker's players on a frame, noting the results in f
+static void sp_run (struct Speculator *sp, struct SpecFrame *f)
+{
+	struct LevelState *g = sp->g;
+	int i;
+	memcpy (f->level, g->level, sp->size);
+	f->frame = ++ g->frame;
+	g->frame_undo = g->undo->len = 0;
+	f->num_ext = 0;
+	g->paradox = 0;
+	f->state = ls_step_range (g, 0, sp->n, &f->num_ext);
+	f->paradox = g->paradox;
+	f->changes->len = 0;
+	for (i = 0; i < g->undo->len; ++ i)
+		v_push (f->changes, v_at (g->undo, i));
+	for (i = 0; i < sp->n; ++ i)
+	{
+		f->ps[i] = *(struct PlayerState *) v_at (g->player_states, i);
+		f->bodies[i] = bd_get (&g->bodies, f->ps[i].id);
+	}
+}
+
+static int sp_worker (void *data)
+{
+	struct Speculator *sp = data;
+	SDL_LockMutex (sp->lock);
+	while (1)
+	{
+		while (!sp->stopping && !sp->seed && (sp->len == SP_AHEAD || sp->done))
+			SDL_CondWait (sp->wake, sp->lock);
+		if (sp->stopping)
+			break;
+		if (sp->seed)
+		{
+			if (sp->g)
+				sp_free_fork (sp->g);
+			sp->g = sp->seed;
+			sp->seed = NULL;
+		}
+		int gen = sp->gen;
+		struct SpecFrame *f = &sp->ring[(sp->head + sp->len) % SP_AHEAD];
+		SDL_UnlockMutex (sp->lock);
+
+		// nobody else looks at a slot until len covers it
+		sp_run (sp, f);
+
+		SDL_LockMutex (sp->lock);
+		if (gen != sp->gen)
+			continue; // reseeded meanwhile: f started from the wrong place
+		++ sp->len;
+		sp->done = f->state != 0;
+		SDL_CondSignal (sp->ready);
+	}
+	SDL_UnlockMutex (sp->lock);
+	return 0;
+}
+
+/* start moving a level's recorded players ahead from where they are now;
+ * returns NULL if there are none */
+struct Speculator *sp_start (struct LevelState *ls)
+{
+	Vector pss = ls->player_states;
+	int n = pss->len;
+	if (n && ((struct PlayerState *) v_at (pss, n-1))->rec.curinput == -1)
+		-- n; // the live player
+	if (!n)
+		return NULL;
+	struct Speculator *sp = mm_alloc (MM_OTHER, sizeof(struct Speculator));
+	*sp = (struct Speculator) {n, strlen (ls->level), NULL, sp_fork (ls), 0, {{0,},}, 0, 0, 0, 0,
+		SDL_CreateMutex (), SDL_CreateCond (), SDL_CreateCond (), NULL};
+	int i;
+	for (i = 0; i < SP_AHEAD; ++ i)
+		sp->ring[i] = (struct SpecFrame) {0, mm_alloc (MM_LEVEL, sp->size),
+			v_dinit (sizeof(struct TileChange), MM_HISTORY), mm_alloc (MM_PLAYERS, sizeof(struct PlayerState) * n),
+			mm_alloc (MM_PLAYERS, sizeof(struct Body) * n), 0, 0, 0};
+	sp->worker = SDL_CreateThread (sp_worker, "sp_worker", sp);
+	return sp;
+}
+
+/* at the start of a frame (ls->frame already counted), move the recorded
+ * players through it as the worker did, if the worker's guess about the
+ * level held; *num_ext and *state are as for ls_step_range.
+ * returns how many players were moved: 0 if the frame must be run as usual */
+int sp_take (struct Speculator *sp, struct LevelState *ls, int *num_ext, int *state)
+{
+	SDL_LockMutex (sp->lock);
+	while (!sp->len && !sp->done)
+		SDL_CondWait (sp->ready, sp->lock);
+	if (!sp->len)
+	{
+		SDL_UnlockMutex (sp->lock);
+		return 0;
+	}
+	struct SpecFrame *f = &sp->ring[sp->head];
+	SDL_UnlockMutex (sp->lock);
+
+	int i, n = 0;
+	if (f->frame == ls->frame && !memcmp (f->level, ls->level, sp->size))
+	{
+		for (i = 0; i < f->changes->len; ++ i)
+		{
+			struct TileChange *tc = v_at (f->changes, i);
+			ls_set_tile (ls, tc->b, tc->to);
+		}
+		for (i = 0; i < sp->n; ++ i)
+		{
+			struct PlayerState *ps = v_at (ls->player_states, i);
+			*ps = f->ps[i];
+			ps->rec.runs = &ls->runs; // not the worker's
+			bd_set (&ls->bodies, ps->id, &f->bodies[i]);
+		}
+		*num_ext = f->num_ext;
+		*state = f->state;
+		ls->paradox = f->paradox;
+		n = sp->n;
+	}
+
+	SDL_LockMutex (sp->lock);
+	sp->head = (sp->head + 1) % SP_AHEAD;
+	-- sp->len;
+	SDL_CondSignal (sp->wake);
+	SDL_UnlockMutex (sp->lock);
+	return n;
+}
+
+// throw away everything worked out so far and start again from ls as it is now
+void sp_reseed (struct Speculator *sp, struct LevelState *ls)
+{
+	struct LevelState *g = sp_fork (ls);
+	SDL_LockMutex (sp->lock);
+	if (sp->seed)
+		sp_free_fork (sp->seed);
+	sp->seed = g;
+	++ sp->gen;
+	sp->len = 0;
+	sp->done = 0;
+	SDL_CondSignal (sp->wake);
+	SDL_UnlockMutex (sp->lock);
+}
+
+void sp_stop (struct Speculator *sp)
+{
+	SDL_LockMutex (sp->lock);
+	sp->stopping = 1;
+	SDL_CondSignal (sp->wake);
+	SDL_UnlockMutex (sp->lock);
+	SDL_WaitThread (sp->worker, NULL);
+
+	if (sp->g)
+		sp_free_fork (sp->g);
+	if (sp->seed)
+		sp_free_fork (sp->seed);
+	int i;
+	for (i = 0; i < SP_AHEAD; ++ i)
+	{
+		mm_free (sp->ring[i].level);
+		v_free (sp->ring[i].changes);
+		mm_free (sp->ring[i].ps);
+		mm_free (sp->ring[i].bodies);
+	}
+	SDL_DestroyCond (sp->wake);
+	SDL_DestroyCond (sp->ready);
+	SDL_DestroyMutex (sp->lock);
+	mm_free (sp);
+}
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
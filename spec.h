@@ -0,0 +1,27 @@
+#ifndef SPEC_H_INCLUDED
+#define SPEC_H_INCLUDED
+
+#include "level.h"
+
+/* Prefix sp_ is for running ghosts ahead of the live player.
+ * Recorded players only depend on the level, and the live player (always
+ * the last one) only changes the level through levers and remote presses,
+ * so a worker thread can move every recorded player up to SP_AHEAD frames
+ * ahead on its own copy of the level, assuming the live player changes
+ * nothing. sp_take hands over the next of those frames if the level is
+ * what the worker assumed it would be at its start; otherwise the frame is
+ * run as usual and sp_reseed sets the worker going again from after it.
+ * Only for LS_SERIAL, where recorded players move before the live one. */
+
+#define SP_AHEAD 8
+
+struct Speculator;
+
+struct Speculator *sp_start (struct LevelState *);
+int  sp_take   (struct Speculator *, struct LevelState *, int *, int *);
+void sp_reseed (struct Speculator *, struct LevelState *);
+void sp_stop   (struct Speculator *);
+
+#endif /* SPEC_H_INCLUDED */
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
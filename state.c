@@ -0,0 +1,356 @@
+#include "state.h"
+
+#include "mem.h"
+#include "spec.h"
+#include "hash.h"
+#include <math.h>
+#include <string.h>
+
+/* A blob is, in order:
+ *   "TTSS", version, total length
+ *   levelw, levelh, bytes in the level, then level, initlevel and ctrl
+ *   (each with its 0), whether there's a cantravel and if so it, then
+ *   the length of action and it
+ *   frame, camx, camy, update, maxvel, paradox, tile_hash
+ *   the undo log (length, then struct TileChanges) and frame_undo
+ *   the key runs (length, then struct Keys)
+ *   the bodies (length, then struct Body)
+ *   the players (length, then struct PlayerStates)
+ *   the hash chain (length, or -1 for none, then uint64_ts)
+ * with ints and floats as they are in memory. */
+
+#define SS_MAGIC "TTSS"
+
+static void ss_put (struct SaveState *ss, const void *p, size_t n)
+{
+	if (ss->len + n > ss->cap)
+	{
+		ss->cap = ss->cap ? ss->cap*2 : 4096;
+		if (ss->cap < ss->len + n)
+			ss->cap = ss->len + n;
+		ss->data = mm_realloc (MM_HISTORY, ss->data, ss->cap);
+	}
+	memcpy (ss->data + ss->len, p, n);
+	ss->len += n;
+}
+
+#define PUT(v) ss_put (ss, &(v), sizeof(v))
+
+static void ss_put_int (struct SaveState *ss, int i)
+{
+	PUT(i);
+}
+
+/* write ls into ss, replacing whatever was there and reusing its memory */
+void ss_save (struct SaveState *ss, struct LevelState *ls)
+{
+	int i, n = strlen (ls->level) + 1;
+	ss->len = 0;
+	ss_put (ss, SS_MAGIC, 4);
+	ss_put_int (ss, SS_VERSION);
+	ss_put_int (ss, 0); // total length, filled in at the end
+	ss_put_int (ss, ls->levelw);
+	ss_put_int (ss, ls->levelh);
+	ss_put_int (ss, n);
+	ss_put (ss, ls->level, n);
+	ss_put (ss, ls->initlevel, n);
+	ss_put (ss, ls->ctrl, n);
+	ss_put_int (ss, ls->cantravel != NULL);
+	if (ls->cantravel)
+		ss_put (ss, ls->cantravel, ls->levelw + 1);
+	n = strlen (ls->action) + 1;
+	ss_put_int (ss, n);
+	ss_put (ss, ls->action, n);
+
+	PUT(ls->frame);
+	PUT(ls->camx);
+	PUT(ls->camy);
+	PUT(ls->update);
+	PUT(ls->maxvel);
+	PUT(ls->paradox);
+	PUT(ls->tile_hash);
+
+	PUT(ls->undo->len);
+	ss_put (ss, ls->undo->data, ls->undo->len * ls->undo->siz);
+	PUT(ls->frame_undo);
+
+	PUT(ls->runs.len);
+	// a chunk at a time
+	for (i = 0; i < ls->runs.len; i = 2*i + KR_FIRST)
+	{
+		n = i + KR_FIRST < ls->runs.len - i ? i + KR_FIRST : ls->runs.len - i;
+		ss_put (ss, kr_at (&ls->runs, i), n * sizeof(struct Keys));
+	}
+
+	PUT(ls->bodies.len);
+	for (i = 0; i < ls->bodies.len; ++ i)
+	{
+		struct Body b = bd_get (&ls->bodies, i);
+		PUT(b);
+	}
+
+	PUT(ls->player_states->len);
+	ss_put (ss, ls->player_states->data, ls->player_states->len * ls->player_states->siz);
+
+	ss_put_int (ss, ls->hashes ? ls->hashes->len : -1);
+	if (ls->hashes)
+		ss_put (ss, ls->hashes->data, ls->hashes->len * ls->hashes->siz);
+
+	n = ss->len;
+	memcpy (ss->data + 8, &n, sizeof(int));
+}
+
+#undef PUT
+
+// reading a blob; runs off the end are noted rather than read
+struct SsReader
+{
+	const unsigned char *p, *end;
+	int bad; // tried to read past the end, or found something impossible
+};
+
+// copy the next n bytes to dst (or skip them if dst is NULL)
+static const void *ss_get (struct SsReader *r, void *dst, size_t n)
+{
+	const void *p = r->p;
+	if (r->bad || n > (size_t) (r->end - r->p))
+	{
+		r->bad = 1;
+		if (dst)
+			memset (dst, 0, n);
+		return NULL;
+	}
+	if (dst)
+		memcpy (dst, r->p, n);
+	r->p += n;
+	return p;
+}
+
+// a count of things of size siz, which must all be in what's left
+static int ss_get_count (struct SsReader *r, size_t siz, int least)
+{
+	int n;
+	ss_get (r, &n, sizeof(int));
+	if (n < least || (n > 0 && (size_t) n > (size_t) (r->end - r->p) / siz))
+		r->bad = 1;
+	return r->bad ? 0 : n;
+}
+
+// the next n bytes, which must be a string of n-1 chars and its 0
+static const char *ss_get_string (struct SsReader *r, int n)
+{
+	const char *s = ss_get (r, NULL, n);
+	if (s && memchr (s, 0, n) != s + n - 1)
+		r->bad = 1;
+	return r->bad ? NULL : s;
+}
+
+// the strings that make up the level: point s's at them in the blob
+static void ss_get_setup (struct SsReader *r, struct Setup *s, int *levelh, const char **level)
+{
+	const unsigned char *start = r->p;
+	char magic[4];
+	int version, len, n;
+	ss_get (r, magic, 4);
+	ss_get (r, &version, sizeof(int));
+	ss_get (r, &len, sizeof(int));
+	if (r->bad || memcmp (magic, SS_MAGIC, 4) || version != SS_VERSION || len != r->end - start)
+	{
+		r->bad = 1;
+		return;
+	}
+	ss_get (r, &s->levelw, sizeof(int));
+	ss_get (r, levelh, sizeof(int));
+	n = ss_get_count (r, 3, 2);
+	*level = ss_get_string (r, n);
+	s->initlevel = ss_get_string (r, n);
+	s->control = ss_get_string (r, n);
+	if (s->levelw <= 0 || (n - 2)/s->levelw + 1 != *levelh)
+		r->bad = 1;
+	s->cantravel = NULL;
+	if (ss_get_count (r, 1, 0))
+		s->cantravel = ss_get_string (r, s->levelw + 1);
+	n = ss_get_count (r, 1, 1);
+	s->action = ss_get_string (r, n);
+}
+
+// a position and velocity a body could have in ls's level
+static int ss_body_ok (const struct LevelState *ls, float x, float y, float xv, float yv, float limit)
+{
+	return x >= 0 && x < ls->levelw*blockwidth && y >= 0 && y < ls->levelh*blockwidth &&
+		fabsf (xv) <= limit && fabsf (yv) <= limit;
+}
+
+/* Go through a blob, putting what it says into ls if apply is set, else
+ * just checking it. The blob must be of the same level as ls (the same
+ * starting tiles and levers), and hang together: tiles and bodies in range,
+ * the tile hash right for the tiles, every player with a body of its own and
+ * only where its recording could be. Returns 0 if it isn't, or doesn't. */
+static int ss_walk (struct LevelState *ls, const void *blob, size_t size, int apply)
+{
+	struct SsReader r = {blob, (const unsigned char *) blob + size, 0};
+	struct Setup s;
+	const char *level;
+	int i, n, levelh, len;
+	ss_get_setup (&r, &s, &levelh, &level);
+	if (r.bad || s.levelw != ls->levelw || strcmp (s.initlevel, ls->initlevel) ||
+		strcmp (s.control, ls->ctrl) || strcmp (s.action, ls->action) || !s.cantravel != !ls->cantravel ||
+		(s.cantravel && strcmp (s.cantravel, ls->cantravel)) || strlen (level) != strlen (ls->level))
+		return 0;
+	len = strlen (level);
+	// only the tiles that differ, which a fork may share (undo and tile_hash are overwritten below)
+	for (i = 0; apply && level[i]; ++ i)
+		ls_set_tile (ls, i, level[i]);
+	struct LevelState scratch, *dst = apply ? ls : &scratch; // where the plain fields go
+#define GET(v) ss_get (&r, &(v), sizeof(v))
+	GET(dst->frame);
+	GET(dst->camx);
+	GET(dst->camy);
+	GET(dst->update);
+	GET(dst->maxvel);
+	GET(dst->paradox);
+	GET(dst->tile_hash);
+	if (dst->frame < 0 || (dst->update != LS_SERIAL && dst->update != LS_TWO_PHASE) ||
+		!(dst->maxvel > 0 && dst->maxvel <= MAX_SUBSTEPS*maxvel) || dst->tile_hash != hc_level (level))
+		r.bad = 1;
+
+	n = ss_get_count (&r, sizeof(struct TileChange), 0);
+	if (apply)
+		ls->undo->len = 0;
+	for (i = 0; i < n && !r.bad; ++ i)
+	{
+		struct TileChange tc;
+		GET(tc);
+		if (tc.b < 0 || tc.b >= len || !tc.from || !tc.to)
+			r.bad = 1; // ls_rollback would write outside the level
+		else if (apply)
+			v_push (ls->undo, &tc);
+	}
+	GET(dst->frame_undo);
+	if (dst->frame_undo < 0 || dst->frame_undo > n)
+		r.bad = 1;
+
+	int num_runs = n = ss_get_count (&r, sizeof(struct Keys), 0);
+	const unsigned char *runs = r.p;
+	if (apply)
+		ls->runs.len = 0;
+	for (i = 0; i < n && !r.bad; ++ i)
+	{
+		struct Keys k;
+		GET(k);
+		if (k.frames <= 0)
+			r.bad = 1;
+		else if (apply)
+			kr_push (&ls->runs, &k);
+	}
+
+	int num_bodies = n = ss_get_count (&r, sizeof(struct Body), 0);
+	if (apply)
+		ls->bodies.len = 0;
+	for (i = 0; i < n && !r.bad; ++ i)
+	{
+		struct Body b;
+		GET(b);
+		if (!ss_body_ok (ls, b.x, b.y, b.xv, b.yv, dst->maxvel))
+			r.bad = 1;
+		else if (apply)
+			bd_add (&ls->bodies, &b);
+	}
+
+	n = ss_get_count (&r, sizeof(struct PlayerState), 0);
+	if (n != num_bodies)
+		r.bad = 1; // players and bodies are added together and never removed
+	if (apply)
+		ls->player_states->len = 0;
+	for (i = 0; i < n && !r.bad; ++ i)
+	{
+		struct PlayerState ps;
+		struct PlayerRecording *rec = &ps.rec;
+		struct Keys k = {{0,}, 0};
+		GET(ps);
+		if (ps.id != i || rec->first < 0 || rec->len < 0 ||
+			rec->first > num_runs - rec->len || rec->curinput < -1 || rec->curinput > rec->len ||
+			!(ps.plw > 0 && ps.plw < blockwidth) ||
+			!ss_body_ok (ls, rec->i_plx, rec->i_ply, rec->i_plxv, rec->i_plyv, dst->maxvel))
+			r.bad = 1; // must have their own body and runs, and start somewhere they could
+		else if (rec->curinput == -1 && (i != n - 1 || rec->first + rec->len != num_runs))
+			r.bad = 1; // the live player is the newest, so its runs are at the end
+		else if (rec->curinput >= 0 && ps.extant)
+		{
+			if (rec->curinput < rec->len)
+				memcpy (&k, runs + (rec->first + rec->curinput) * sizeof(struct Keys), sizeof(struct Keys));
+			if (rec->curframe < 0 || rec->curframe >= k.frames)
+				r.bad = 1; // somewhere in a run it hasn't finished
+		}
+		if (!r.bad && apply)
+		{
+			rec->runs = &ls->runs;
+			v_push (ls->player_states, &ps);
+		}
+	}
+
+	n = ss_get_count (&r, sizeof(uint64_t), -1);
+	if (apply && n >= 0 && !ls->hashes)
+		ls->hashes = v_dinit (sizeof(uint64_t), MM_HISTORY);
+	if (apply && n < 0 && ls->hashes)
+	{
+		v_free (ls->hashes);
+		ls->hashes = NULL;
+	}
+	if (apply && n >= 0)
+		ls->hashes->len = 0;
+	for (i = 0; i < n && !r.bad; ++ i)
+	{
+		uint64_t h;
+		GET(h);
+		if (apply)
+			v_push (ls->hashes, &h);
+	}
+#undef GET
+	return !r.bad && r.p == r.end;
+}
+
+/* put ls back how it was when the blob was saved; it must be the same
+ * level. Returns 0, leaving ls alone, if the blob is no good */
+int ss_restore (struct LevelState *ls, const void *blob, size_t size)
+{
+	if (!ss_walk (ls, blob, size, 0))
+		return 0;
+	// the speculator's worker reads the players and key runs
+	if (ls->spec)
+		sp_stop (ls->spec);
+	ss_walk (ls, blob, size, 1);
+	ls->drawn = 0;
+	if (ls->spec)
+		ls->spec = ls->update == LS_SERIAL ? sp_start (ls) : NULL;
+	return 1;
+}
+
+/* make a new level for en from a blob; returns NULL if the blob is no good */
+struct LevelState *ss_load (struct Engine *en, const void *blob, size_t size)
+{
+	struct SsReader r = {blob, (const unsigned char *) blob + size, 0};
+	struct Setup s;
+	const char *level;
+	int levelh;
+	ss_get_setup (&r, &s, &levelh, &level);
+	if (r.bad)
+		return NULL;
+	s.i_plx = s.i_ply = 0;
+	struct LevelState *ls = ls_init (en, &s);
+	if (!ss_restore (ls, blob, size))
+	{
+		ls_free (ls);
+		return NULL;
+	}
+	return ls;
+}
+
+void ss_free (struct SaveState *ss)
+{
+	if (ss->data)
+		mm_free (ss->data);
+	*ss = (struct SaveState) {NULL, 0, 0};
+}
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
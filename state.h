@@ -0,0 +1,35 @@
+#ifndef STATE_H_INCLUDED
+#define STATE_H_INCLUDED
+
+#include "level.h"
+#include <stddef.h>
+
+/* Prefix ss_ is for savestates.
+ * ss_save writes everything about a level in play - its tiles, levers,
+ * frame, camera, undo log, every player with its body and where its
+ * recording is up to, every recorded key run and the hash chain - into
+ * one binary blob, and ss_restore puts the same level back to exactly
+ * that state (ss_load makes a new level from one); in play, k keeps one
+ * and l puts it back. Both are a single pass of copies, reusing the blob's
+ * and the level's memory, so they are cheap enough to do every frame. A
+ * blob is checked through before any of it is used, and refused if it
+ * isn't a state the level could be in. Blobs are versioned, but are in the
+ * machine's own byte order and struct layout: they're for suspending and
+ * resuming on the same build, not for sharing. */
+
+#define SS_VERSION 1
+
+struct SaveState
+{
+	unsigned char *data; // the blob
+	size_t len, cap; // bytes used, and allocated
+};
+
+void ss_save    (struct SaveState *, struct LevelState *);
+int  ss_restore (struct LevelState *, const void *, size_t);
+struct LevelState *ss_load (struct Engine *, const void *, size_t);
+void ss_free    (struct SaveState *);
+
+#endif /* STATE_H_INCLUDED */
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
@@ -0,0 +1,16 @@
+#include "tile.h"
+#include "graphics.h"
+
+/* a air, g ground, l lever (off), L lever (on), s spikes, * goal;
+ * anything else is like air but not affected by levers */
+const struct TileType tile_types[256] =
+{
+	['a'] = {0,         0,                        'g', 'g',  0 },
+	['g'] = {TT_SOLID,  PIXEL_VALUE(150, 100, 20), 'a',  0,  'a'},
+	['l'] = {TT_LEVER,  PIXEL_VALUE(100, 150, 100), 'L', 'L',  0 },
+	['L'] = {TT_LEVER,  PIXEL_VALUE(0, 200, 150),  'l',  0,  'l'},
+	['s'] = {TT_HAZARD, PIXEL_VALUE(255, 0, 0),     0,   0,   0 },
+	['*'] = {TT_GOAL,   PIXEL_VALUE(255, 200, 0),   0,   0,   0 },
+};
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
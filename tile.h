@@ -0,0 +1,30 @@
+#ifndef TILE_H_INCLUDED
+#define TILE_H_INCLUDED
+
+#include <stdint.h>
+
+/* Everything the engine knows about a kind of tile, looked up by the tile's
+ * character so that hot paths do one indexed load instead of comparing
+ * against each tile character in turn. To add a tile, give it an entry in
+ * tile_types. */
+
+#define TT_SOLID  0x01 // players can't overlap it
+#define TT_HAZARD 0x02 // players die standing in it
+#define TT_GOAL   0x04 // players can finish the level in it
+#define TT_LEVER  0x08 // '.' activates whatever ctrl says it controls
+
+struct TileType
+{
+	int flags; // TT_*
+	uint32_t colour; // as drawn, or 0 if see-through
+	char flip; // what a flip-flop lever turns it into, or 0 if unaffected
+	char on, off; // what a permanent lever switching it on or off turns it into, or 0
+};
+
+extern const struct TileType tile_types[256];
+
+#define TILE(c) (&tile_types[(unsigned char) (c)])
+
+#endif /* TILE_H_INCLUDED */
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
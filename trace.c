@@ -0,0 +1,162 @@
+#include "trace.h"
+
+#include <stdio.h>
+
+#ifdef NO_TRACE
+
+int tr_init (const char *path)
+{
+	fprintf (stderr, "Built without tracing\n");
+	return 0;
+}
+
+#else
+
+#include "SDL.h"
+#include "mem.h"
+
+// one span
+struct TrEvent
+{
+	const char *name;
+	uint64_t start, end; // performance counter values
+};
+
+// a thread's spans not yet written out
+struct TrBuffer
+{
+	int tid; // the thread's timeline in the trace
+	int len;
+	SDL_SpinLock lock; // held while adding a span, or writing them out
+	struct TrBuffer *all, *spare; // every buffer; buffers whose threads have ended
+	struct TrEvent events[TR_EVENTS];
+};
+
+int tr_on = 0;
+static FILE *tr_file;
+static int tr_written; // spans in the file so far
+static SDL_mutex *tr_lock; // for the file and the lists of buffers
+static SDL_TLSID tr_tls; // this thread's buffer
+static struct TrBuffer *tr_all, *tr_spare;
+static int tr_threads; // timelines handed out
+static uint64_t tr_start; // counter value at tr_init
+static double tr_us; // microseconds a counter tick
+
+// write out a buffer's spans; with tr_lock and the buffer's lock held
+static void tr_write (struct TrBuffer *b)
+{
+	int i;
+	for (i = 0; i < b->len && tr_file; ++ i)
+	{
+		struct TrEvent *e = &b->events[i];
+		fprintf (tr_file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			tr_written ++ ? ",\n" : "", e->name, b->tid,
+			(e->start - tr_start)*tr_us, (e->end - e->start)*tr_us);
+	}
+	b->len = 0;
+}
+
+// a thread has ended: write out what's left of its buffer and keep it for the next
+static void tr_release (void *data)
+{
+	struct TrBuffer *b = data;
+	SDL_LockMutex (tr_lock);
+	SDL_AtomicLock (&b->lock);
+	tr_write (b);
+	SDL_AtomicUnlock (&b->lock);
+	b->spare = tr_spare;
+	tr_spare = b;
+	SDL_UnlockMutex (tr_lock);
+}
+
+// this thread's buffer, given it one if it hasn't got one yet
+static struct TrBuffer *tr_buffer ()
+{
+	struct TrBuffer *b = SDL_TLSGet (tr_tls);
+	if (b)
+		return b;
+	SDL_LockMutex (tr_lock);
+	if ((b = tr_spare))
+		tr_spare = b->spare;
+	else
+	{
+		b = mm_alloc (MM_OTHER, sizeof(struct TrBuffer));
+		b->lock = 0;
+		b->all = tr_all;
+		tr_all = b;
+	}
+	b->tid = ++ tr_threads;
+	b->len = 0;
+	SDL_UnlockMutex (tr_lock);
+	SDL_TLSSet (tr_tls, b, tr_release);
+	return b;
+}
+
+uint64_t tr_now ()
+{
+	return SDL_GetPerformanceCounter ();
+}
+
+void tr_event (const char *name, struct TrSample *s)
+{
+	if (!s->t)
+		return; // began before tracing did
+	struct TrBuffer *b = tr_buffer ();
+	uint64_t end = tr_now ();
+	// only tr_finish, writing out every buffer at exit, ever waits for this
+	SDL_AtomicLock (&b->lock);
+	b->events[b->len ++] = (struct TrEvent) {name, s->t, end};
+	if (b->len == TR_EVENTS)
+	{
+		SDL_AtomicUnlock (&b->lock);
+		SDL_LockMutex (tr_lock);
+		SDL_AtomicLock (&b->lock);
+		tr_write (b);
+		SDL_UnlockMutex (tr_lock);
+	}
+	SDL_AtomicUnlock (&b->lock);
+}
+
+// write out every thread's spans and finish the file
+static void tr_finish ()
+{
+	struct TrBuffer *b;
+	tr_on = 0;
+	SDL_LockMutex (tr_lock);
+	for (b = tr_all; b; b = b->all)
+	{
+		// threads still going may be adding to theirs
+		SDL_AtomicLock (&b->lock);
+		tr_write (b);
+		SDL_AtomicUnlock (&b->lock);
+	}
+	fprintf (tr_file, "\n]\n");
+	if (fclose (tr_file))
+		fprintf (stderr, "trace: write failed\n");
+	tr_file = NULL; // threads still going have missed the end
+	SDL_UnlockMutex (tr_lock);
+}
+
+/* start tracing into a file, finished at exit (so call it after anything
+ * registered with atexit that must come after, like SDL_Quit); returns 0
+ * if it can't be written */
+int tr_init (const char *path)
+{
+	if (!(tr_file = fopen (path, "w")))
+	{
+		fprintf (stderr, "Can't write %s\n", path);
+		return 0;
+	}
+	fprintf (tr_file, "[\n");
+	tr_lock = SDL_CreateMutex ();
+	tr_tls = SDL_TLSCreate ();
+	tr_start = SDL_GetPerformanceCounter ();
+	tr_us = 1e6 / SDL_GetPerformanceFrequency ();
+	tr_on = 1;
+	atexit (tr_finish);
+	return 1;
+}
+
+#endif
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
@@ -0,0 +1,39 @@
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+#include <stdint.h>
+
+/* Prefix tr_ is for trace events, written as Chrome trace JSON (load the
+ * file in chrome://tracing or ui.perfetto.dev). Whatever runs between
+ * tr_begin and tr_end is one span on the calling thread's timeline. Each
+ * thread keeps its spans in a buffer of its own and writes them out when it
+ * fills, when the thread ends or at exit, so threads don't contend for
+ * anything while tracing (a buffer's lock is only wanted by anyone else at
+ * exit, when whatever threads are still going are written out too). Until
+ * tr_init turns tracing on, tr_begin and tr_end are a test of one flag;
+ * build with -DNO_TRACE to leave them out altogether. */
+
+#define TR_EVENTS 4096 // spans a thread keeps before writing them out
+
+// time at tr_begin
+struct TrSample
+{
+	uint64_t t; // 0 if tracing was off
+};
+
+int  tr_init  (const char *);
+
+#ifdef NO_TRACE
+#  define tr_begin(s)    ((void) (s))
+#  define tr_end(name,s) ((void) (s))
+#else
+extern int tr_on;
+uint64_t tr_now   ();
+void     tr_event (const char *, struct TrSample *);
+#  define tr_begin(s)    ((void) ((s)->t = tr_on ? tr_now () : 0))
+#  define tr_end(name,s) ((void) (tr_on ? tr_event (name, s) : (void) 0))
+#endif
+
+#endif /* TRACE_H_INCLUDED */
+
+/* vim: set noexpandtab ts=4 sts=4 sw=4 : */
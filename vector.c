@@ -1,22 +1,33 @@
 #include "vector.h"
 
-#include <malloc.h>
+#include "mem.h"
+
 #include <string.h>
 #include <stdint.h>
 
 #define V_DEFAULT_LENGTH 2
-Vector v_dinit (int siz)
+Vector v_dinit (int siz, int tag)
 {
-	return v_init (siz, V_DEFAULT_LENGTH);
+	return v_init (siz, V_DEFAULT_LENGTH, tag);
 }
 
-Vector v_init (int siz, int mlen)
+Vector v_init (int siz, int mlen, int tag)
 {
-	Vector vec = malloc (sizeof(*vec));
-	vec->data = malloc (siz * mlen);
+	Vector vec = mm_alloc (tag, sizeof(*vec));
+	vec->data = mm_alloc (tag, siz * mlen);
 	vec->siz = siz;
 	vec->len = 0;
 	vec->mlen = mlen;
+	vec->tag = tag;
+	return vec;
+}
+
+// a new vector with the same things in it
+Vector v_copy (Vector from)
+{
+	Vector vec = v_init (from->siz, from->len > V_DEFAULT_LENGTH ? from->len : V_DEFAULT_LENGTH, from->tag);
+	memcpy (vec->data, from->data, from->len * from->siz);
+	vec->len = from->len;
 	return vec;
 }
 
@@ -27,7 +38,7 @@ void *v_push (Vector vec, void *data)
 	if (vec->len >= vec->mlen)
 	{
 		vec->mlen = V_NEXT_LENGTH(vec->mlen);
-		vec->data = realloc (vec->data, vec->mlen * vec->siz);
+		vec->data = mm_realloc (vec->tag, vec->data, vec->mlen * vec->siz);
 	}
 	memcpy (DATA(vec->len), data, vec->siz);
 	++ vec->len;
@@ -39,7 +50,7 @@ void *v_pstr (Vector vec, char *data)
 	if (vec->len >= vec->mlen)
 	{
 		vec->mlen = V_NEXT_LENGTH(vec->mlen);
-		vec->data = realloc (vec->data, vec->mlen * vec->siz);
+		vec->data = mm_realloc (vec->tag, vec->data, vec->mlen * vec->siz);
 	}
 	memcpy (DATA(vec->len), data, strlen (data) + 1);
 	++ vec->len;
@@ -69,8 +80,8 @@ void v_rptr (Vector vec, void *data)
 
 void v_free (Vector vec)
 {
-	free (vec->data);
-	free (vec);
+	mm_free (vec->data);
+	mm_free (vec);
 }
 
 int v_isin (Vector vec, void *data)
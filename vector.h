@@ -8,11 +8,13 @@ struct vector_
 {
 	void *data;
 	int siz, len, mlen;
+	int tag; // MM_ tag for the memory it uses
 };
 
 /* init */
-Vector v_dinit (int);
-Vector v_init  (int, int);
+Vector v_dinit (int, int);
+Vector v_init  (int, int, int);
+Vector v_copy  (Vector);
 
 /* write */
 void  *v_push  (Vector, void *);